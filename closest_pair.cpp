@@ -4,13 +4,80 @@
 *	Course: ITEC360-01 Project 1
 *
 *	Purpose: This program operates on a collection of 2D points and will determine
-*		the closest pair.  The program has two algorithms to calculate the closest pair,
-*		one Brute Force and one Divide and Conquer.  The Divide and Conquer relies
-*		on the points being sorted, to do this, I have implemented two version of a merge
-*		sort, one to sort by x and one to sort by y.
+*		the closest pair.  It started with two algorithms, one Brute Force and one Divide and
+*		Conquer that relies on the points being sorted by x and by y, and now has these:
+*
+*			brute		Brute Force, vectorized over separate x and y arrays
+*			divide		Divide and Conquer, copying the halves at every level
+*			inplace		Divide and Conquer on index ranges of the presorted arrays
+*			parallel	inplace on a work stealing thread pool
+*			grid		Randomized grid hashing, O(n) expected
+*			sweep		Plane sweep with an active set ordered by y
+*			shamos		Divide and Conquer with only the x presort, merging by y on return
+*			iterative	shamos bottom up, without recursion
+*			both		brute and divide, one after the other
+*
+*		Options turn the same input into other queries: "--top-k" (the K closest pairs),
+*		"--all-nn" (every point's nearest neighbour, kd-tree), "--blue" (the closest red blue
+*		pair, kd-tree), "--dim" (D dimensional points) and "--compact" (the narrowest
+*		coordinate type).  These commands take the place of the algorithm:
+*
+*			closest bench		time every engine on random points
+*			closest calibrate	measure the fastest base case cutoff
+*			closest convert		turn a text point file into a binary one
+*			closest index		build a kd-tree index file or answer queries from one
+*			closest stream		keep the closest pair of points arriving on std input
+*			closest windowbench	time the sliding window closest pair
+*			closest selftest	check the query engines against brute force
 *
 *		The program and either take an argument for which algorithm to use or will ask
 *		the user.  Points are supplied as ints and should be given as pairs.
+*		The options below can come before or after the algorithm.
+*
+*		"inplace" runs the Divide and Conquer on index ranges of the presorted arrays with
+*		a single scratch buffer, so the recursion does not allocate.  "parallel" runs the
+*		same search on a work stealing thread pool, "closest parallel --threads 8".
+*		The presorts use a radix sort, "--sort merge" switches back to the merge sorts.
+*		"grid" runs the randomized grid hashing method in O(n) expected time, its sample
+*		is drawn from "--seed S".  "sweep" runs a plane sweep over the x sorted points with
+*		an active set ordered by y.  "shamos" runs the divide and conquer with only the x presort,
+*		building the y order by merging the halves as the recursion returns.  "iterative" runs it
+*		bottom up, merging blocks of doubling size level by level without any recursion.
+*
+*		"--input FILE" reads the same count then pairs format from a file, memory mapped and
+*		parsed in parallel, instead of from std input.  "closest convert IN OUT" turns such a
+*		file into a binary point file sorted by x.  "--input" also takes binary files, they are
+*		mapped read only and not parsed.  "inplace", "parallel" and "sweep" run on the mapped
+*		points without copying them, the other engines copy the points they reorder.
+*
+*		"closest stream" reads x y pairs until the input ends and prints the closest pair
+*		every time a new point changes it.  "closest windowbench" times the sliding window
+*		closest pair (last W points) against recomputing each window from scratch.
+*		"--top-k K" lists the K closest pairs with their squared distances instead, and
+*		"--all-nn" gives every point its nearest neighbour using a kd-tree.
+*
+*		"--compact" reads the points in the narrowest of int16, int32, int64, float or double that
+*		holds them and runs the in place divide and conquer on that type.
+*
+*		"--dim D" reads points with D coordinates each, 3 to 8, and runs a D dimensional divide
+*		and conquer, brute force or grid hash ("grid") on them.
+*
+*		"--blue FILE" finds the closest pair with one point from the normal input (red) and one
+*		from FILE (blue), using a kd-tree over the smaller set.
+*
+*		"closest index build POINTS INDEX" saves a kd-tree over the points, and
+*		"closest index query INDEX QUERIES" prints the nearest indexed point of every query point
+*		("--pair" for the closest pair each query point is part of) without rebuilding it.
+*
+*		"--cutoff N" brute forces ranges of up to N points (3 to 64) instead of recursing down to 3.
+*		"--cutoff auto" uses the fastest cutoff measured by "closest calibrate", which is cached
+*		in ~/.closest_pair.cfg (or $CLOSEST_CONFIG), and calibrates first if there is none.
+*
+*		"closest bench --sizes 1000,100000 --reps 5 --warmup 1 --json out.json --csv out.csv"
+*		times every engine on random points and reports median and p95 times, points per
+*		second and the peak RSS while each engine ran.  "closest selftest --trials 50 --n 300"
+*		checks the incremental and sliding window structures, top-k, all-nn, the red blue pair
+*		and a saved and loaded kd-tree index against brute force on random points.
 *
 *	Sample Input:
 *		>closest brute
@@ -32,9 +99,9 @@
 *		Point 1: (1, 1)
 *		Point 2: (2, 2)
 *		
-*		Distance squared: 1
+*		Distance squared: 2
 *		
-*		Distance: 1
+*		Distance: 1.41421
 *		
 *		Number of distance calcs: 28
 *		
@@ -43,24 +110,209 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <cmath>
 #include <ctime>
 #include <climits>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <random>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <queue>
+#include <chrono>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <limits>
+#include <array>
+#include <cerrno>
+#include <sstream>
+#include <iterator>
+
+#ifdef _WIN32
+	#define CLOSEST_NO_MMAP 1
+	#define NOMINMAX
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+	#include <psapi.h>
+#else
+	#include <sys/resource.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define CLOSEST_X86 1
+	#define CLOSEST_TARGET(isa) __attribute__((target(isa)))
+	#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	#define CLOSEST_X86 1
+	#define CLOSEST_TARGET(isa)
+	#include <intrin.h>
+	#include <immintrin.h>
+#endif
+
 using namespace std;
 
-//! Global to count the number of times we run the distance calculation
-volatile int DISTANCE_CALCULATIONS = 0;
+/**
+ *	Counters for what the engines do, one set per thread.
+ *	
+ *	Every thread counts into its own STATS, so the hot loops never share or lock anything.  A thread
+ *	pool adds its workers' counts into the thread that owns it when it is destroyed, so once an
+ *	engine returns, the calling thread's STATS hold the whole run.  Building with CLOSEST_NO_STATS
+ *	compiles every update out and the counters stay zero.
+ */
+struct Stats
+{
+	long long distanceCalcs = 0;	//!< Distance calculations
+	long long recursiveCalls = 0;	//!< Calls of the recursive searches
+	long long baseCases = 0;		//!< Recursions that were brute forced
+	long long strips = 0;			//!< Strips scanned across a split
+	long long stripPoints = 0;		//!< Points in all of those strips
+	long long stripComparisons = 0;	//!< Pairs compared while scanning them
+	long long largestStrip = 0;		//!< Points in the largest strip
+	long long maxDepth = 0;			//!< Deepest recursion seen by any one thread
+
+	void add(const Stats& other)
+	{
+		distanceCalcs += other.distanceCalcs;
+		recursiveCalls += other.recursiveCalls;
+		baseCases += other.baseCases;
+		strips += other.strips;
+		stripPoints += other.stripPoints;
+		stripComparisons += other.stripComparisons;
+		largestStrip = max(largestStrip, other.largestStrip);
+		maxDepth = max(maxDepth, other.maxDepth);
+	}
+};
+
+//! The counters of the current thread
+thread_local Stats STATS;
+
+//! Clear the counters of the current thread before a run
+inline void resetStats()
+{
+	STATS = Stats();
+}
+
+//! How deep the current thread is inside the recursive searches
+thread_local int RECURSION_DEPTH = 0;
+
+//! Counts one call of a recursive search and tracks the depth while it runs
+struct StatCall
+{
+	StatCall()
+	{
+		STATS.recursiveCalls++;
+		STATS.maxDepth = max(STATS.maxDepth, (long long)++RECURSION_DEPTH);
+	}
+
+	~StatCall()
+	{
+		RECURSION_DEPTH--;
+	}
+};
+
+//! Count one scanned strip, its comparisons are also distance calculations
+inline void recordStrip(long long points, long long compared)
+{
+	STATS.strips++;
+	STATS.stripPoints += points;
+	STATS.stripComparisons += compared;
+	STATS.distanceCalcs += compared;
+	STATS.largestStrip = max(STATS.largestStrip, points);
+}
+
+#ifdef CLOSEST_NO_STATS
+	#define STAT_ADD(counter, n) ((void)0)
+	#define STAT_STRIP(points, compared) ((void)(compared))
+	#define STAT_CALL() ((void)0)
+#else
+	#define STAT_ADD(counter, n) (STATS.counter += (n))
+	#define STAT_STRIP(points, compared) recordStrip((points), (compared))
+	#define STAT_CALL() StatCall statCall
+#endif
 
-//! Global to count the number of recursive calls the sorting algorithm makes
-int RECURSIVE_CALLS = 0;
+//! Ranges smaller than this are not worth handing to another thread
+const int PARALLEL_GRAIN = 1 << 14;
 
-//! A simple data type that contains an x and a y.
-struct Point
+//! A simple data type that contains an x and a y, of any coordinate type.
+template<class T>
+struct BasicPoint
 {
-	Point(int x, int y) : x{x}, y{y} 
+	BasicPoint(T x, T y) : x{x}, y{y} 
 	{}
 
-	int x;
-	int y;
+	T x;
+	T y;
+};
+
+//! The points every engine works on, int coordinates within +-2^30
+typedef BasicPoint<int> Point;
+
+//! Largest coordinate magnitude of a Point, so two differences squared still fit a long long
+const int MAX_COORD = (1 << 30) - 1;
+
+//! Check a coordinate read from input against MAX_COORD
+inline bool inCoordRange(long long v)
+{
+	return v >= -MAX_COORD && v <= MAX_COORD;
+}
+
+#ifdef __SIZEOF_INT128__
+	//! Exact squared distance for 64 bit coordinates within +-2^62
+	typedef __int128 WideDist;
+#else
+	//! No 128 bit integer here, 64 bit coordinates get a rounded distance
+	typedef long double WideDist;
+#endif
+
+/**
+ *	The type squared distances between points with T coordinates are accumulated in.
+ *	
+ *	For the integer types the squared distance is exact, as long as the coordinates are within the
+ *	documented range.  Float and double coordinates get a double distance, rounded like any other
+ *	floating point sum.
+ */
+template<class T> struct CoordTraits;
+
+template<> struct CoordTraits<int16_t>
+{
+	typedef long long Dist;
+	static const char* name() { return "int16"; }
+};
+
+template<> struct CoordTraits<int32_t>
+{
+	typedef long long Dist;
+	static const char* name() { return "int32"; }
+};
+
+template<> struct CoordTraits<int64_t>
+{
+	typedef WideDist Dist;
+	static const char* name() { return "int64"; }
+};
+
+template<> struct CoordTraits<float>
+{
+	typedef double Dist;
+	static const char* name() { return "float"; }
+};
+
+template<> struct CoordTraits<double>
+{
+	typedef double Dist;
+	static const char* name() { return "double"; }
 };
 
 //! Simple enum used to store which algorithm the program should use.
@@ -68,9 +320,25 @@ enum Algorithm
 {
 	BRUTE,
 	DIVIDE,
+	INPLACE,
+	PARALLEL,
+	GRID,
+	SWEEP,
+	SHAMOS,
+	ITERATIVE,
 	BOTH
 };
 
+//! Which sort divideClosestPoint uses for the X and Y presorts.
+enum SortMethod
+{
+	MERGE_SORT,
+	RADIX_SORT
+};
+
+//! The presort used by divideClosestPoint and parallelClosestPoint
+SortMethod selected_sort = RADIX_SORT;
+
 
 /**
  *	@brief	Generate a random point and return it.
@@ -83,632 +351,6236 @@ Point getRandomPoint()
 }
 
 
+/**
+ *	@brief		Square a value without going through floating point.
+ *	
+ *	@param v	Value to square
+ *	
+ *	@return v*v
+ */
+inline long long sq( long long v)
+{
+	return v*v;
+}
+
 
 /**
- *	@brief		Calculate the Euclidean Distance between two points.
+ *	@brief		Calculate the exact squared Euclidean Distance between two points.
  *	
  *	@param a	Point A
  *	@param b	Point B
  *	
- *	@return The Euclidean Distance between A and B
+ *	@return The squared distance between A and B
  */
-double euclidDist( Point a, Point b)
+template<class T>
+inline typename CoordTraits<T>::Dist distSquared( const BasicPoint<T>& a, const BasicPoint<T>& b)
 {
-	DISTANCE_CALCULATIONS += 1;
-	return sqrt( pow(a.x - b.x, 2) + pow(a.y - b.y, 2) );
+	typedef typename CoordTraits<T>::Dist Dist;
+	Dist dx = Dist(a.x) - Dist(b.x);
+	Dist dy = Dist(a.y) - Dist(b.y);
+	return dx*dx + dy*dy;
 }
 
+
 /**
- *	@brief	Using brute force, calculate the two closest points and their distance.  
+ *	@brief		Square the difference of two coordinates in their distance type.
  *	
- *	@param points		Vector of points to find the closest pair in.
- *	@param closestPair	Will contain a copy of the two closest points.
+ *	@param a	First coordinate
+ *	@param b	Second coordinate
  *	
- *	@return Int. The Euclidean distance between the two closest points in the data set.
+ *	@return (a-b)^2
  */
-double bruteForceClosestPair( vector<Point>& points, pair<Point, Point>& closestPair)
+template<class T>
+inline typename CoordTraits<T>::Dist sqDiff( T a, T b)
 {
-	double dist = INT_MAX;
-	
-	for(int i = 0; i < points.size(); i++)
+	typedef typename CoordTraits<T>::Dist Dist;
+	Dist d = Dist(a) - Dist(b);
+	return d*d;
+}
+
+
+
+/**
+ *	@brief	Scalar brute force kernel over separate x and y arrays.
+ *	
+ *	All of the kernels compare exact squared distances and keep the first pair, in (i, j) order,
+ *	that has the smallest distance.  Coordinates must stay within MAX_COORD so that the vector
+ *	kernels' differences fit in an int and the squared distance fits in a long long.
+ *	
+ *	@param xs	x values of the points
+ *	@param ys	y values of the points
+ *	@param n	Number of points
+ *	@param bi	Index of the first point of the closest pair
+ *	@param bj	Index of the second point of the closest pair
+ *	
+ *	@return The squared distance between the two closest points, LLONG_MAX if n < 2.
+ */
+long long bruteForceKernelScalar(const int* xs, const int* ys, size_t n, size_t& bi, size_t& bj)
+{
+	long long best = LLONG_MAX;
+
+	for(size_t i = 0; i < n; i++)
 	{
-		for(int j = i+1; j < points.size(); j++)
+		for(size_t j = i+1; j < n; j++)
 		{
-			double temp = euclidDist(points[i], points[j]);
-			if( temp < dist )
+			long long dx = (long long)xs[i] - xs[j];
+			long long dy = (long long)ys[i] - ys[j];
+			long long dist = dx*dx + dy*dy;
+			if( dist < best )
 			{
-				dist = temp;
-
-				closestPair.first = points[i];
-				closestPair.second = points[j];
+				best = dist;
+				bi = i;
+				bj = j;
 			}
 		}
 	}
 
-	return dist;
+	return best;
 }
 
-// Q SORTING
+#ifdef CLOSEST_X86
 /**
- *	@brief		Merge the points back together based on their y value
- *	
- *	@param l	left index in the vector
- *	@param m	middle index in the vector
- *	@param r	right index in the vector
+ *	@brief	Recheck the 8 lanes starting at j one at a time, after the vector compare saw an improvement.
  *	
- *	@return Void.
+ *	@return The new best squared distance.
  */
-void merge(vector<pair<Point, Point*>>& points, int l, int m, int r)
+inline long long rescanLanes(const int* xs, const int* ys, size_t i, size_t j, long long best, size_t& bi, size_t& bj)
 {
-	int i, j, k;
-	int n1 = m - l + 1;
-	int n2 = r - m;
-
-	// Create temp storage and copy the unmerged points into it
-	vector<pair<Point, Point*>> L, R;
-	for(i = 0; i < n1; i++)
-		L.push_back(points[l+i]);
-	for(j = 0; j < n2; j++)
-		R.push_back(points[m + 1 + j]);
-
-	i = 0;
-    j = 0;
-    k = l;
-
-	// Merge the points of L and R back into points
-    while (i < n1 && j < n2)
-    {
-        if (L[i].first.y <= R[j].first.y)
-        {
-            points[k] = L[i];
-            i++;
-        }
-        else
-        {
-            points[k] = R[j];
-            j++;
-        }
-        k++;
-    }
-
-	// L has remaining points, merge them
-    while (i < n1)
-    {
-        points[k] = L[i];
-        i++;
-        k++;
-    }
+	for(size_t k = j; k < j + 8; k++)
+	{
+		long long dx = (long long)xs[i] - xs[k];
+		long long dy = (long long)ys[i] - ys[k];
+		long long dist = dx*dx + dy*dy;
+		if( dist < best )
+		{
+			best = dist;
+			bi = i;
+			bj = k;
+		}
+	}
 
-	// R has remaining points, merge them
-    while (j < n2)
-    {
-        points[k] = R[j];
-        j++;
-        k++;
-    }
+	return best;
 }
 
 /**
- *	@brief	Mergesort the point inside points between l and r based on their y value.
+ *	@brief	Square the 4 int lanes of v into 64 bit results.
  *	
- *	@param points	vector of points to sort
- *	@param l		left bound of the sort
- *	@param r		right bound of the sort
+ *	_mm_mul_epi32 only multiplies the even lanes into 64 bit results, so the odd lanes are
+ *	shifted down into the even ones for a second multiply.
  *	
- *	@return Void.
+ *	@param v		Values to square, differences of coordinates within MAX_COORD
+ *	@param even		Set to the squares of lanes 0 and 2
+ *	@param odd		Set to the squares of lanes 1 and 3
  */
-void mergeSort(vector<pair<Point, Point*>>& points, int l, int r)
+CLOSEST_TARGET("sse4.2")
+inline void squareLanesSSE4(__m128i v, __m128i& even, __m128i& odd)
 {
-	if(l < r)
-	{
-		int mid = l+(r-l)/2;
-
-		mergeSort(points, l, mid);
-		mergeSort(points, mid+1, r);
-
-		merge(points, l, mid, r);
-	}
+	even = _mm_mul_epi32(v, v);
+	v = _mm_srli_epi64(v, 32);
+	odd = _mm_mul_epi32(v, v);
 }
 
-
-// P SORTING
 /**
- *	@brief		Merge the points back together based on their x value
+ *	@brief	Square the 8 int lanes of v into 64 bit results, the same split as squareLanesSSE4.
  *	
- *	@param l	left index in the vector
- *	@param m	middle index in the vector
- *	@param r	right index in the vector
+ *	@param v		Values to square
+ *	@param even		Set to the squares of lanes 0, 2, 4 and 6
+ *	@param odd		Set to the squares of lanes 1, 3, 5 and 7
+ */
+CLOSEST_TARGET("avx2")
+inline void squareLanesAVX2(__m256i v, __m256i& even, __m256i& odd)
+{
+	even = _mm256_mul_epi32(v, v);
+	v = _mm256_srli_epi64(v, 32);
+	odd = _mm256_mul_epi32(v, v);
+}
+
+/**
+ *	@brief	SSE4.2 brute force kernel, two 4 lane registers give 8 points per step.
  *	
- *	@return Void.
+ *	Same contract as bruteForceKernelScalar.
  */
-void merge(vector<Point>& points, int l, int m, int r)
+CLOSEST_TARGET("sse4.2")
+long long bruteForceKernelSSE4(const int* xs, const int* ys, size_t n, size_t& bi, size_t& bj)
 {
-	int i, j, k;
-	int n1 = m - l + 1;
-	int n2 = r - m;
+	long long best = LLONG_MAX;
 
-	// Copy the points inside of our bounds into L and R
-	vector<Point> L, R;
-	for(i = 0; i < n1; i++)
-		L.push_back(points[l+i]);
-	for(j = 0; j < n2; j++)
-		R.push_back(points[m + 1 + j]);
+	for(size_t i = 0; i < n; i++)
+	{
+		__m128i xi = _mm_set1_epi32(xs[i]);
+		__m128i yi = _mm_set1_epi32(ys[i]);
+		size_t j = i+1;
 
-	i = 0;
-    j = 0;
-    k = l;
+		for(; j + 8 <= n; j += 8)
+		{
+			__m128i vbest = _mm_set1_epi64x(best);
+			__m128i hit = _mm_setzero_si128();
 
-	// Merge the points of L and R back into points based on their x value
-    while (i < n1 && j < n2)
-    {
-        if (L[i].x <= R[j].x)
-        {
-            points[k] = L[i];
-            i++;
-        }
-        else
-        {
-            points[k] = R[j];
-            j++;
-        }
-        k++;
-    }
+			for(int h = 0; h < 8; h += 4)
+			{
+				__m128i dx = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(xs + j + h)), xi);
+				__m128i dy = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(ys + j + h)), yi);
 
-	// Points remain in L, copy them
-    while (i < n1)
-    {
-        points[k] = L[i];
-        i++;
-        k++;
-    }
+				__m128i xEven, xOdd, yEven, yOdd;
+				squareLanesSSE4(dx, xEven, xOdd);
+				squareLanesSSE4(dy, yEven, yOdd);
+				__m128i even = _mm_add_epi64(xEven, yEven);
+				__m128i odd = _mm_add_epi64(xOdd, yOdd);
 
-	// Points remain in R, copy them
-    while (j < n2)
-    {
-        points[k] = R[j];
-        j++;
-        k++;
-    }
+				hit = _mm_or_si128(hit, _mm_cmpgt_epi64(vbest, even));
+				hit = _mm_or_si128(hit, _mm_cmpgt_epi64(vbest, odd));
+			}
+
+			if( !_mm_testz_si128(hit, hit) )
+				best = rescanLanes(xs, ys, i, j, best, bi, bj);
+		}
+
+		for(; j < n; j++)
+		{
+			long long dx = (long long)xs[i] - xs[j];
+			long long dy = (long long)ys[i] - ys[j];
+			long long dist = dx*dx + dy*dy;
+			if( dist < best )
+			{
+				best = dist;
+				bi = i;
+				bj = j;
+			}
+		}
+	}
+
+	return best;
 }
 
 /**
- *	@brief	Mergesort the point inside points between l and r based on their x value.
+ *	@brief	AVX2 brute force kernel, 8 points per step.
  *	
- *	@param points	vector of points to sort
- *	@param l		left bound of the sort
- *	@param r		right bound of the sort
- *	
- *	@return Void.
+ *	Same contract as bruteForceKernelScalar.
  */
-void mergeSort(vector<Point>& points, int l, int r)
+CLOSEST_TARGET("avx2")
+long long bruteForceKernelAVX2(const int* xs, const int* ys, size_t n, size_t& bi, size_t& bj)
 {
-	if(l < r)
+	long long best = LLONG_MAX;
+
+	for(size_t i = 0; i < n; i++)
 	{
-		int mid = l+(r-l)/2;
+		__m256i xi = _mm256_set1_epi32(xs[i]);
+		__m256i yi = _mm256_set1_epi32(ys[i]);
+		size_t j = i+1;
 
-		mergeSort(points, l, mid);
-		mergeSort(points, mid+1, r);
+		for(; j + 8 <= n; j += 8)
+		{
+			__m256i vbest = _mm256_set1_epi64x(best);
+			__m256i dx = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(xs + j)), xi);
+			__m256i dy = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(ys + j)), yi);
 
-		merge(points, l, mid, r);
+			__m256i xEven, xOdd, yEven, yOdd;
+			squareLanesAVX2(dx, xEven, xOdd);
+			squareLanesAVX2(dy, yEven, yOdd);
+			__m256i even = _mm256_add_epi64(xEven, yEven);
+			__m256i odd = _mm256_add_epi64(xOdd, yOdd);
+
+			__m256i hit = _mm256_or_si256(_mm256_cmpgt_epi64(vbest, even), _mm256_cmpgt_epi64(vbest, odd));
+			if( !_mm256_testz_si256(hit, hit) )
+				best = rescanLanes(xs, ys, i, j, best, bi, bj);
+		}
+
+		for(; j < n; j++)
+		{
+			long long dx = (long long)xs[i] - xs[j];
+			long long dy = (long long)ys[i] - ys[j];
+			long long dist = dx*dx + dy*dy;
+			if( dist < best )
+			{
+				best = dist;
+				bi = i;
+				bj = j;
+			}
+		}
 	}
-}
 
+	return best;
+}
 
 /**
- *	@brief		Calculate the Euclidean Distance between two points.
+ *	@brief	Check which vector instructions the CPU and OS support.
  *	
- *	@param a	Point A
- *	@param b	Point B
- *	
- *	@return The Euclidean Distance between A and B
+ *	@return 2 for AVX2, 1 for SSE4.2, 0 for neither.
  */
-double divideClosetPointSearch(vector< Point >& P, vector<pair<Point, Point*>>& Q, pair<Point, Point>& closest)
+int detectVectorLevel()
 {
-	RECURSIVE_CALLS++;
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
 
-	// P is small enough, just bruteforce it
-	if(P.size() <= 3)
+	__cpuid(info, 1);
+	bool sse42 = (info[2] >> 20) & 1;
+	bool osxsave = (info[2] >> 27) & 1;
+	bool avx2 = false;
+	if( maxLeaf >= 7 && osxsave && (_xgetbv(0) & 6) == 6 )
 	{
-		return bruteForceClosestPair(P, closest);
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] >> 5) & 1;
 	}
-	else
-	{
-		// Generate the strip
-		int mid = P[P.size()/2].x;
 
-		// Points on the left of mid
-		vector<Point> PL;
-		for(int i = 0; i < int(P.size()/2); i++)
-		{
+	return avx2 ? 2 : (sse42 ? 1 : 0);
+#else
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports("avx2") )
+		return 2;
+	if( __builtin_cpu_supports("sse4.2") )
+		return 1;
+	return 0;
+#endif
+}
+#endif
+
+//! Signature shared by the brute force kernels
+typedef long long (*BruteForceKernel)(const int*, const int*, size_t, size_t&, size_t&);
+
+/**
+ *	@brief	Pick the fastest brute force kernel this CPU can run.
+ *	
+ *	@return The kernel to use.
+ */
+BruteForceKernel selectBruteForceKernel()
+{
+#ifdef CLOSEST_X86
+	int level = detectVectorLevel();
+	if( level == 2 )
+		return bruteForceKernelAVX2;
+	if( level == 1 )
+		return bruteForceKernelSSE4;
+#endif
+	return bruteForceKernelScalar;
+}
+
+//! The brute force kernel chosen for this CPU at startup
+const BruteForceKernel bruteForceKernel = selectBruteForceKernel();
+
+//! Ranges up to this size are copied into arrays on the stack for the kernel
+const int KERNEL_STACK_POINTS = 64;
+
+//! Name of the brute force kernel in use, calibration results only hold for the same kernel
+const char* bruteForceKernelName()
+{
+#ifdef CLOSEST_X86
+	if( bruteForceKernel == bruteForceKernelAVX2 )
+		return "avx2";
+	if( bruteForceKernel == bruteForceKernelSSE4 )
+		return "sse4.2";
+#endif
+	return "scalar";
+}
+
+//! The classic base case, recursion stops at 3 points
+const int DEFAULT_CUTOFF = 3;
+
+//! Largest base case, so the kernel's copy of it stays on the stack
+const int MAX_CUTOFF = KERNEL_STACK_POINTS;
+
+//! Ranges of at most this many points are brute forced by the divide and conquer searches
+int selected_cutoff = DEFAULT_CUTOFF;
+
+
+/**
+ *	@brief	Using brute force, calculate the two closest points in a raw range of points.
+ *	
+ *	The points are split into x and y arrays and handed to the vector kernel.
+ *	
+ *	@param points		Pointer to the first point of the range.
+ *	@param n			Number of points in the range.
+ *	@param closestPair	Will contain a copy of the two closest points.
+ *	
+ *	@return The squared distance between the two closest points in the range, LLONG_MAX if n < 2.
+ */
+long long bruteForceClosestPair( const Point* points, size_t n, pair<Point, Point>& closestPair)
+{
+	if( n < 2 )
+		return LLONG_MAX;
+
+	int stackX[KERNEL_STACK_POINTS], stackY[KERNEL_STACK_POINTS];
+	vector<int> heapX, heapY;
+	int* xs = stackX;
+	int* ys = stackY;
+	if( n > size_t(KERNEL_STACK_POINTS) )
+	{
+		heapX.resize(n);
+		heapY.resize(n);
+		xs = heapX.data();
+		ys = heapY.data();
+	}
+
+	for(size_t i = 0; i < n; i++)
+	{
+		xs[i] = points[i].x;
+		ys[i] = points[i].y;
+	}
+
+	size_t bi = 0, bj = 1;
+	long long best = bruteForceKernel(xs, ys, n, bi, bj);
+	STAT_ADD(distanceCalcs, (long long)n*(n-1)/2);
+
+	closestPair.first = points[bi];
+	closestPair.second = points[bj];
+
+	return best;
+}
+
+/**
+ *	@brief	Using brute force, calculate the two closest points of any coordinate type.
+ *	
+ *	The vector kernels only take int coordinates, the other types are checked pair by pair.
+ *	
+ *	@param points		Pointer to the first point of the range.
+ *	@param n			Number of points in the range.
+ *	@param closestPair	Will contain a copy of the two closest points.
+ *	
+ *	@return The squared distance between the two closest points in the range.
+ */
+template<class T>
+typename CoordTraits<T>::Dist bruteForceClosestPair( const BasicPoint<T>* points, size_t n, pair<BasicPoint<T>, BasicPoint<T>>& closestPair)
+{
+	typedef typename CoordTraits<T>::Dist Dist;
+	Dist best = 0;
+	bool found = false;
+
+	for(size_t i = 0; i < n; i++)
+	{
+		for(size_t j = i+1; j < n; j++)
+		{
+			Dist dist = distSquared(points[i], points[j]);
+			if( !found || dist < best )
+			{
+				best = dist;
+				found = true;
+				closestPair.first = points[i];
+				closestPair.second = points[j];
+			}
+		}
+	}
+	STAT_ADD(distanceCalcs, (long long)n*(n-1)/2);
+
+	return best;
+}
+
+/**
+ *	@brief	Using brute force, calculate the two closest points and their distance.  
+ *	
+ *	@param points		Vector of points to find the closest pair in.
+ *	@param closestPair	Will contain a copy of the two closest points.
+ *	
+ *	@return The squared distance between the two closest points in the data set.
+ */
+long long bruteForceClosestPair( vector<Point>& points, pair<Point, Point>& closestPair)
+{
+	return bruteForceClosestPair(points.data(), points.size(), closestPair);
+}
+
+// STRIP
+//! Points a strip point is compared with, the rest are provably at least d away
+const int STRIP_LOOKAHEAD = 7;
+
+/**
+ *	@brief	Largest whole offset r with r*r < d, the strip is every x within r of the middle.
+ *	
+ *	@param d	Squared distance of the closest pair found so far
+ *	
+ *	@return The strip radius, -1 when d leaves no strip at all.
+ */
+inline long long stripRadius(long long d)
+{
+	if( d <= 0 )
+		return -1;
+	// Wider than any two int coordinates can be apart
+	if( d > (1LL << 62) )
+		return 1LL << 32;
+
+	long long r = (long long)sqrt(double(d));
+	while( r > 0 && r*r >= d )
+		r--;
+	while( (r+1)*(r+1) < d )
+		r++;
+	return r;
+}
+
+/**
+ *	@brief	Copy the points with lo <= x <= hi into xs and ys, without a branch per point.
+ *	
+ *	Every point is written at the end of the strip and the end only moves past it if it is
+ *	inside.  The end never passes the point being read, so nothing past xs[count - 1] is written.
+ *	
+ *	@param coords	x of the first point, its y follows it
+ *	@param stride	Distance from one point's x to the next, in ints
+ *	@param count	Number of points
+ *	@param lo		Smallest x in the strip
+ *	@param hi		Largest x in the strip
+ *	@param xs		x values of the strip
+ *	@param ys		y values of the strip
+ *	
+ *	@return The number of points in the strip.
+ */
+size_t compactStripScalar(const int* coords, int stride, size_t count, int lo, int hi, int* xs, int* ys)
+{
+	size_t size = 0;
+	for(size_t i = 0; i < count; i++)
+	{
+		int x = coords[i*stride];
+		xs[size] = x;
+		ys[size] = coords[i*stride + 1];
+		size += (x >= lo) & (x <= hi);
+	}
+
+	return size;
+}
+
+/**
+ *	@brief	Compare strip point i with its next STRIP_LOOKAHEAD points while they are within best in y.
+ *	
+ *	@return The new best squared distance, bi and bj are only set if it is below the one passed in.
+ */
+inline long long scanStripPoint(const int* xs, const int* ys, size_t size, size_t i, long long best, size_t& bi, size_t& bj, long long& compared)
+{
+	size_t end = min(size, i + 1 + STRIP_LOOKAHEAD);
+	for(size_t k = i+1; k < end && sq((long long)ys[k] - ys[i]) < best; k++)
+	{
+		compared++;
+		long long dx = (long long)xs[k] - xs[i];
+		long long dy = (long long)ys[k] - ys[i];
+		long long dist = dx*dx + dy*dy;
+		if( dist < best )
+		{
+			best = dist;
+			bi = i;
+			bj = k;
+		}
+	}
+
+	return best;
+}
+
+/**
+ *	@brief	Compare every strip point with the next STRIP_LOOKAHEAD points while they are within best in y.
+ *	
+ *	@param xs			x values of the strip, sorted by y
+ *	@param ys			y values of the strip
+ *	@param size			Number of points in the strip
+ *	@param best			Squared distance to beat
+ *	@param bi			Index of the first point of a closer pair
+ *	@param bj			Index of the second point of a closer pair
+ *	@param compared		Number of distances checked is added here
+ *	
+ *	@return The new best squared distance, bi and bj are only set if it is below the one passed in.
+ */
+long long scanStripScalar(const int* xs, const int* ys, size_t size, long long best, size_t& bi, size_t& bj, long long& compared)
+{
+	for(size_t i = 0; i < size; i++)
+		best = scanStripPoint(xs, ys, size, i, best, bi, bj, compared);
+
+	return best;
+}
+
+#ifdef CLOSEST_X86
+//! Shuffle that packs the kept lanes of every 8 bit keep mask to the front, and how many there are
+struct StripPermuteTable
+{
+	int lanes[256][8];
+	int count[256];
+
+	StripPermuteTable()
+	{
+		for(int mask = 0; mask < 256; mask++)
+		{
+			int k = 0;
+			for(int lane = 0; lane < 8; lane++)
+			{
+				if( (mask >> lane) & 1 )
+					lanes[mask][k++] = lane;
+			}
+			count[mask] = k;
+			while( k < 8 )
+				lanes[mask][k++] = 0;
+		}
+	}
+};
+
+const StripPermuteTable STRIP_PERMUTE;
+
+/**
+ *	@brief	AVX2 strip compaction, 8 points are gathered, filtered and packed per step.
+ *	
+ *	Same contract as compactStripScalar.
+ */
+CLOSEST_TARGET("avx2")
+size_t compactStripAVX2(const int* coords, int stride, size_t count, int lo, int hi, int* xs, int* ys)
+{
+	const __m256i index = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+	const __m256i vlo = _mm256_set1_epi32(lo);
+	const __m256i vhi = _mm256_set1_epi32(hi);
+	size_t size = 0;
+	size_t i = 0;
+
+	for(; i + 8 <= count; i += 8)
+	{
+		const int* base = coords + i*stride;
+		__m256i x = _mm256_i32gather_epi32(base, index, 4);
+		__m256i y = _mm256_i32gather_epi32(base + 1, index, 4);
+
+		__m256i outside = _mm256_or_si256(_mm256_cmpgt_epi32(vlo, x), _mm256_cmpgt_epi32(x, vhi));
+		int keep = ~_mm256_movemask_ps(_mm256_castsi256_ps(outside)) & 0xFF;
+
+		__m256i perm = _mm256_loadu_si256((const __m256i*)STRIP_PERMUTE.lanes[keep]);
+		_mm256_storeu_si256((__m256i*)(xs + size), _mm256_permutevar8x32_epi32(x, perm));
+		_mm256_storeu_si256((__m256i*)(ys + size), _mm256_permutevar8x32_epi32(y, perm));
+		size += STRIP_PERMUTE.count[keep];
+	}
+
+	return size + compactStripScalar(coords + i*stride, stride, count - i, lo, hi, xs + size, ys + size);
+}
+
+/**
+ *	@brief	Put the 4 bit masks of the even and odd lanes back into one 8 bit mask in lane order.
+ */
+inline int interleaveLanes(int even, int odd)
+{
+	int mask = 0;
+	for(int b = 0; b < 4; b++)
+		mask |= ((even >> b) & 1) << (2*b) | ((odd >> b) & 1) << (2*b + 1);
+	return mask;
+}
+
+/**
+ *	@brief	AVX2 strip scan, all STRIP_LOOKAHEAD successors of a point are checked in one step.
+ *	
+ *	The vector step reads the 8 entries after a point, so the last points of the strip, and any
+ *	point with a successor within best, are finished by scanStripPoint.  compared counts the same
+ *	distances the scalar scan checks, the successors before the first one that is best or more
+ *	away in y.  Same contract as scanStripScalar otherwise.
+ */
+CLOSEST_TARGET("avx2")
+long long scanStripAVX2(const int* xs, const int* ys, size_t size, long long best, size_t& bi, size_t& bj, long long& compared)
+{
+	size_t i = 0;
+	for(; i + 9 <= size; i++)
+	{
+		// Most strip points have no successor within best in y, skip them before the vector work
+		if( sq((long long)ys[i+1] - ys[i]) >= best )
+			continue;
+
+		__m256i dx = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(xs + i + 1)), _mm256_set1_epi32(xs[i]));
+		__m256i dy = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(ys + i + 1)), _mm256_set1_epi32(ys[i]));
+		__m256i xEven, xOdd, yEven, yOdd;
+		squareLanesAVX2(dx, xEven, xOdd);
+		squareLanesAVX2(dy, yEven, yOdd);
+		__m256i even = _mm256_add_epi64(xEven, yEven);
+		__m256i odd = _mm256_add_epi64(xOdd, yOdd);
+
+		// Lane 7 is past the lookahead, it is never compared
+		__m256i vbest = _mm256_set1_epi64x(best);
+		int hitEven = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(vbest, even)));
+		int hitOdd = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(vbest, odd))) & 0x7;
+
+		if( hitEven | hitOdd )
+		{
+			best = scanStripPoint(xs, ys, size, i, best, bi, bj, compared);
+			continue;
+		}
+
+		// best did not change, count the successors that were within it in y
+		int nearEven = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(vbest, yEven)));
+		int nearOdd = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(vbest, yOdd)));
+		int near = interleaveLanes(nearEven, nearOdd);
+		compared += min(STRIP_LOOKAHEAD, __builtin_ctz(~near));
+	}
+
+	for(; i < size; i++)
+		best = scanStripPoint(xs, ys, size, i, best, bi, bj, compared);
+
+	return best;
+}
+#endif
+
+//! Signatures shared by the strip kernels
+typedef size_t (*StripCompactor)(const int*, int, size_t, int, int, int*, int*);
+typedef long long (*StripScanner)(const int*, const int*, size_t, long long, size_t&, size_t&, long long&);
+
+//! The strip kernels chosen for this CPU at startup, the same vector level as the brute force kernel
+#ifdef CLOSEST_X86
+const StripCompactor compactStrip = bruteForceKernel == bruteForceKernelAVX2 ? compactStripAVX2 : compactStripScalar;
+const StripScanner scanStrip = bruteForceKernel == bruteForceKernelAVX2 ? scanStripAVX2 : scanStripScalar;
+#else
+const StripCompactor compactStrip = compactStripScalar;
+const StripScanner scanStrip = scanStripScalar;
+#endif
+
+/**
+ *	Strip space of one search, x and y kept apart for the kernels.  It is allocated once by the
+ *	driver of a search and the strip of the range [lo, hi) is built in [lo, hi) of it, so the
+ *	recursion never allocates and ranges searched at the same time never share any of it.
+ */
+struct StripBuffer
+{
+	vector<int> xs, ys;
+
+	//! Room for the strips of a search over n points
+	explicit StripBuffer(size_t n = 0) : xs(n), ys(n)
+	{}
+};
+
+/**
+ *	@brief	The x range of the strip around mid for the squared distance d, clamped to int.
+ */
+inline void stripBounds(int mid, long long d, int& lo, int& hi)
+{
+	long long r = stripRadius(d);
+	lo = int(max<long long>(INT_MIN, mid - r));
+	hi = int(min<long long>(INT_MAX, mid + r));
+}
+
+/**
+ *	@brief	Scan a strip that is already in xs and ys and record it in the stats.
+ *	
+ *	@return The squared distance of the closest pair in the strip if it is below d, otherwise d.
+ */
+long long closestInPackedStrip(const int* xs, const int* ys, size_t size, long long d, pair<Point, Point>& closest)
+{
+	size_t bi = 0, bj = 0;
+	long long compared = 0;
+	long long best = scanStrip(xs, ys, size, d, bi, bj, compared);
+	STAT_STRIP(size, compared);
+
+	if( best < d )
+	{
+		closest.first = Point(xs[bi], ys[bi]);
+		closest.second = Point(xs[bj], ys[bj]);
+	}
+
+	return best;
+}
+
+/**
+ *	@brief	Build the strip of a y sorted range around mid and find the closest pair in it.
+ *	
+ *	@param coords	x of the first point, its y follows it
+ *	@param stride	Distance from one point's x to the next, in ints
+ *	@param count	Number of points in the range
+ *	@param mid		x the strip is centred on
+ *	@param d		Closest squared distance found in the two halves
+ *	@param xs		Room for count x values of the strip
+ *	@param ys		Room for count y values of the strip
+ *	@param closest	Set to the closest pair in the strip if it is below d
+ *	
+ *	@return The squared distance of the closest pair in the strip if it is below d, otherwise d.
+ */
+long long closestInStrip(const int* coords, int stride, size_t count, int mid, long long d, int* xs, int* ys, pair<Point, Point>& closest)
+{
+	if( d <= 0 )
+		return d;
+
+	int lo, hi;
+	stripBounds(mid, d, lo, hi);
+	size_t size = compactStrip(coords, stride, count, lo, hi, xs, ys);
+
+	return closestInPackedStrip(xs, ys, size, d, closest);
+}
+
+//! Q entries are read by the strip kernels as rows of ints
+const int Q_STRIDE = sizeof(pair<Point, const Point*>) / sizeof(int);
+static_assert(sizeof(pair<Point, const Point*>) % sizeof(int) == 0, "Q entries must be whole ints");
+
+/**
+ *	@brief	Strip of a range of points sorted by y.
+ */
+long long closestInStrip(const Point* points, size_t count, int mid, long long d, int* xs, int* ys, pair<Point, Point>& closest)
+{
+	return closestInStrip(&points[0].x, 2, count, mid, d, xs, ys, closest);
+}
+
+/**
+ *	@brief	Strip of a range of Q entries sorted by y.
+ */
+long long closestInStrip(const pair<Point, const Point*>* Q, size_t count, int mid, long long d, int* xs, int* ys, pair<Point, Point>& closest)
+{
+	return closestInStrip(&Q[0].first.x, Q_STRIDE, count, mid, d, xs, ys, closest);
+}
+
+/**
+ *	@brief	Strip of a range of Q entries with other coordinate types, checked pair by pair.
+ *	
+ *	@param Q		Entries sorted by y
+ *	@param count	Number of entries
+ *	@param mid		x the strip is centred on
+ *	@param d		Closest squared distance found in the two halves
+ *	@param S		Scratch space for the strip, as large as the range
+ *	@param strip	Not used, only int coordinates are packed
+ *	@param at		Not used
+ *	@param closest	Set to the closest pair in the strip if it is below d
+ *	
+ *	@return The squared distance of the closest pair in the strip if it is below d, otherwise d.
+ */
+template<class T>
+typename CoordTraits<T>::Dist closestInStrip(const pair<BasicPoint<T>, const BasicPoint<T>*>* Q, size_t count, T mid, typename CoordTraits<T>::Dist d, pair<BasicPoint<T>, const BasicPoint<T>*>* S, StripBuffer&, size_t, pair<BasicPoint<T>, BasicPoint<T>>& closest)
+{
+	typedef typename CoordTraits<T>::Dist Dist;
+
+	// Copy all points within d of the middle into S, this forms the strip
+	size_t size = 0;
+	for(size_t k = 0; k < count; k++)
+	{
+		if(sqDiff(Q[k].first.x, mid) < d)
+			S[size++] = Q[k];
+	}
+
+	Dist dminsq = d;
+	long long compared = 0;
+	for(size_t i = 0; i < size; i++)
+	{
+		for(size_t k = i+1; k < size && sqDiff(S[i].first.y, S[k].first.y) < dminsq; k++)
+		{
+			compared++;
+			Dist dist = distSquared(S[i].first, S[k].first);
+			if( dist < dminsq)
+			{
+				dminsq = dist;
+				closest.first = S[i].first;
+				closest.second = S[k].first;
+			}
+		}
+	}
+	STAT_STRIP(size, compared);
+
+	return dminsq;
+}
+
+/**
+ *	@brief	Int coordinates take the packed strip kernels, built at index at of strip, S is not needed.
+ */
+inline long long closestInStrip(const pair<Point, const Point*>* Q, size_t count, int mid, long long d, pair<Point, const Point*>*, StripBuffer& strip, size_t at, pair<Point, Point>& closest)
+{
+	return closestInStrip(Q, count, mid, d, strip.xs.data() + at, strip.ys.data() + at, closest);
+}
+
+// Q SORTING
+/**
+ *	@brief		Merge the points back together based on their y value
+ *	
+ *	@param l	left index in the vector
+ *	@param m	middle index in the vector
+ *	@param r	right index in the vector
+ *	
+ *	@return Void.
+ */
+void merge(vector<pair<Point, const Point*>>& points, long long l, long long m, long long r)
+{
+	long long i, j, k;
+	long long n1 = m - l + 1;
+	long long n2 = r - m;
+
+	// Create temp storage and copy the unmerged points into it
+	vector<pair<Point, const Point*>> L, R;
+	for(i = 0; i < n1; i++)
+		L.push_back(points[l+i]);
+	for(j = 0; j < n2; j++)
+		R.push_back(points[m + 1 + j]);
+
+	i = 0;
+    j = 0;
+    k = l;
+
+	// Merge the points of L and R back into points
+    while (i < n1 && j < n2)
+    {
+        if (L[i].first.y <= R[j].first.y)
+        {
+            points[k] = L[i];
+            i++;
+        }
+        else
+        {
+            points[k] = R[j];
+            j++;
+        }
+        k++;
+    }
+
+	// L has remaining points, merge them
+    while (i < n1)
+    {
+        points[k] = L[i];
+        i++;
+        k++;
+    }
+
+	// R has remaining points, merge them
+    while (j < n2)
+    {
+        points[k] = R[j];
+        j++;
+        k++;
+    }
+}
+
+/**
+ *	@brief	Mergesort the point inside points between l and r based on their y value.
+ *	
+ *	@param points	vector of points to sort
+ *	@param l		left bound of the sort
+ *	@param r		right bound of the sort
+ *	
+ *	@return Void.
+ */
+void mergeSort(vector<pair<Point, const Point*>>& points, long long l, long long r)
+{
+	if(l < r)
+	{
+		long long mid = l+(r-l)/2;
+
+		mergeSort(points, l, mid);
+		mergeSort(points, mid+1, r);
+
+		merge(points, l, mid, r);
+	}
+}
+
+
+// P SORTING
+/**
+ *	@brief		Merge the points back together based on their x value
+ *	
+ *	@param l	left index in the vector
+ *	@param m	middle index in the vector
+ *	@param r	right index in the vector
+ *	
+ *	@return Void.
+ */
+void merge(vector<Point>& points, long long l, long long m, long long r)
+{
+	long long i, j, k;
+	long long n1 = m - l + 1;
+	long long n2 = r - m;
+
+	// Copy the points inside of our bounds into L and R
+	vector<Point> L, R;
+	for(i = 0; i < n1; i++)
+		L.push_back(points[l+i]);
+	for(j = 0; j < n2; j++)
+		R.push_back(points[m + 1 + j]);
+
+	i = 0;
+    j = 0;
+    k = l;
+
+	// Merge the points of L and R back into points based on their x value
+    while (i < n1 && j < n2)
+    {
+        if (L[i].x <= R[j].x)
+        {
+            points[k] = L[i];
+            i++;
+        }
+        else
+        {
+            points[k] = R[j];
+            j++;
+        }
+        k++;
+    }
+
+	// Points remain in L, copy them
+    while (i < n1)
+    {
+        points[k] = L[i];
+        i++;
+        k++;
+    }
+
+	// Points remain in R, copy them
+    while (j < n2)
+    {
+        points[k] = R[j];
+        j++;
+        k++;
+    }
+}
+
+/**
+ *	@brief	Mergesort the point inside points between l and r based on their x value.
+ *	
+ *	@param points	vector of points to sort
+ *	@param l		left bound of the sort
+ *	@param r		right bound of the sort
+ *	
+ *	@return Void.
+ */
+void mergeSort(vector<Point>& points, long long l, long long r)
+{
+	if(l < r)
+	{
+		long long mid = l+(r-l)/2;
+
+		mergeSort(points, l, mid);
+		mergeSort(points, mid+1, r);
+
+		merge(points, l, mid, r);
+	}
+}
+
+
+// RADIX SORTING
+/**
+ *	@brief	Turn a signed coordinate into an unsigned key with the same order.
+ *	
+ *	@param v	The coordinate
+ *	
+ *	@return v with its sign bit flipped.
+ */
+inline unsigned radixKey(int v)
+{
+	return unsigned(v) ^ 0x80000000u;
+}
+
+/**
+ *	@brief	Stable LSD radix sort on a 32 bit key.
+ *	
+ *	Uses 11 bit digits (3 passes) for small inputs where the counts stay in L1 and 16 bit digits
+ *	(2 passes) for large ones.  A pass is skipped when every key has the same digit.  Being stable,
+ *	it leaves equal keys in the same order the merge sort would.
+ *	
+ *	@param items	vector to sort
+ *	@param key		Function giving the unsigned key of an item
+ *	
+ *	@return Void.
+ */
+template<typename T, typename Key>
+void radixSort(vector<T>& items, Key key)
+{
+	size_t n = items.size();
+	if(n < 2)
+		return;
+
+	const int bits = n >= (1 << 20) ? 16 : 11;
+	vector<T> buffer(items);
+	vector<size_t> count((1 << bits) + 1);
+	T* from = items.data();
+	T* to = buffer.data();
+
+	for(int shift = 0; shift < 32; shift += bits)
+	{
+		unsigned mask = (1u << bits) - 1;
+		fill(count.begin(), count.end(), 0);
+
+		for(size_t i = 0; i < n; i++)
+			count[((key(from[i]) >> shift) & mask) + 1]++;
+
+		// Every key has the same digit, nothing would move
+		if(count[((key(from[0]) >> shift) & mask) + 1] == n)
+			continue;
+
+		for(unsigned d = 1; d <= mask; d++)
+			count[d] += count[d-1];
+
+		for(size_t i = 0; i < n; i++)
+			to[count[(key(from[i]) >> shift) & mask]++] = from[i];
+
+		swap(from, to);
+	}
+
+	if(from != items.data())
+		copy(from, from + n, items.data());
+}
+
+/**
+ *	@brief	Sort P by x with the selected sort.
+ *	
+ *	@param P	vector of points to sort
+ *	
+ *	@return Void.
+ */
+void sortByX(vector<Point>& P)
+{
+	if(selected_sort == RADIX_SORT)
+		radixSort(P, [](const Point& p){ return radixKey(p.x); });
+	else
+		mergeSort(P, 0, (long long)P.size()-1);
+}
+
+/**
+ *	@brief	Sort Q by y with the selected sort.
+ *	
+ *	@param Q	vector of points to sort
+ *	
+ *	@return Void.
+ */
+void sortByY(vector<pair<Point, const Point*>>& Q)
+{
+	if(selected_sort == RADIX_SORT)
+		radixSort(Q, [](const pair<Point, const Point*>& q){ return radixKey(q.first.y); });
+	else
+		mergeSort(Q, 0, (long long)Q.size()-1);
+}
+
+
+//! y of the entries the divide and conquer searches sort and merge
+template<class T>
+inline T yOf(const BasicPoint<T>& p)
+{
+	return p.y;
+}
+
+template<class T>
+inline T yOf(const pair<BasicPoint<T>, const BasicPoint<T>*>& q)
+{
+	return q.first.y;
+}
+
+/**
+ *	@brief	Merge the y sorted runs from[lo, m) and from[m, hi) into to[lo, hi).
+ *	
+ *	Equal y values keep the entry of the first run first, so the merge is stable.
+ *	
+ *	@param from		Holds the two runs
+ *	@param to		Gets the merged range, must not overlap from
+ *	@param lo		First index of the first run
+ *	@param m		First index of the second run
+ *	@param hi		One past the last index of the second run
+ *	
+ *	@return Void.
+ */
+template<class E>
+void mergeByY(const E* from, E* to, size_t lo, size_t m, size_t hi)
+{
+	size_t i = lo;
+	size_t j = m;
+	size_t k = lo;
+	while(i < m && j < hi)
+	{
+		if(yOf(from[i]) <= yOf(from[j]))
+			to[k++] = from[i++];
+		else
+			to[k++] = from[j++];
+	}
+	while(i < m)
+		to[k++] = from[i++];
+	while(j < hi)
+		to[k++] = from[j++];
+}
+
+/**
+ *	@brief	Sort the few entries of a base case A[lo, hi) by y with an insertion sort.
+ *	
+ *	@return Void.
+ */
+template<class E>
+void insertionSortByY(E* A, size_t lo, size_t hi)
+{
+	for(size_t i = lo + 1; i < hi; i++)
+	{
+		E e = A[i];
+		size_t j = i;
+		for(; j > lo && yOf(A[j-1]) > yOf(e); j--)
+			A[j] = A[j-1];
+		A[j] = e;
+	}
+}
+
+
+/**
+ *	@brief		Find the closest pair with divide and conquer.
+ *	
+ *	Every P here is a copy of a contiguous slice of the top level P, and Q holds pointers into the
+ *	top level P.  Q is split by that position rather than by comparing x with the middle, so points
+ *	that share the middle x still go to the same half as their copy in P and the halves stay
+ *	exactly balanced.  Equal x values are ordered by their input order, which the stable presort
+ *	keeps.
+ *	
+ *	@param P		Points sorted by x
+ *	@param base		Where the slice P is a copy of starts in the top level P
+ *	@param Q		Points sorted by y, with a pointer to their copy in the top level P
+ *	@param strip	Room for the strip of the top level Q, every level builds its strip from the start
+ *	@param closest	A copy of the two closest points will be stored in closest
+ *	
+ *	@return The squared distance between the two closest points
+ */
+long long divideClosetPointSearch(vector< Point >& P, const Point* base, vector<pair<Point, const Point*>>& Q, StripBuffer& strip, pair<Point, Point>& closest)
+{
+	STAT_CALL();
+
+	// P is small enough, just bruteforce it
+	if(P.size() <= size_t(selected_cutoff))
+	{
+		STAT_ADD(baseCases, 1);
+		return bruteForceClosestPair(P, closest);
+	}
+	else
+	{
+		// Generate the strip
+		int mid = P[P.size()/2].x;
+
+		// Points on the left of mid
+		vector<Point> PL;
+		for(size_t i = 0; i < P.size()/2; i++)
+		{
 			PL.push_back(P[i]);
 		}
 
-		// Points on the right of mid
-		vector<Point> PR;
-		for(int i = int(P.size()/2); i < int(P.size()); i++)
+		// Points on the right of mid
+		vector<Point> PR;
+		for(size_t i = P.size()/2; i < P.size(); i++)
+		{
+			PR.push_back(P[i]);
+		}
+
+		// PL is the first half of the slice that starts at base
+		const Point* split = base + PL.size();
+
+		// Copy the same points of PL and PR, but maintain the Y sort order
+		vector<pair<Point, const Point*>> QL;
+		vector<pair<Point, const Point*>> QR;
+		for(auto& q : Q)
+		{
+			if( q.second < split)
+				QL.push_back(q);
+			else
+				QR.push_back(q);
+		}
+
+		// Find the closest pair on the left
+		pair<Point, Point> cl{PL[0], PL[1]};
+		long long dl = divideClosetPointSearch(PL, base, QL, strip, cl);
+
+		// Find the closest pair on the right
+		pair<Point, Point> cr{PR[0], PR[1]};
+		long long dr = divideClosetPointSearch(PR, split, QR, strip, cr);
+
+		// Find the closest of the two
+		long long d;
+		if( dl < dr)
+		{
+			closest = cl;
+			d = dl;
+		}
+		else
+		{
+			closest = cr;
+			d = dr;
+		}
+
+		// Find the closest pair across the middle in the strip of Q
+		return closestInStrip(Q.data(), Q.size(), mid, d, strip.xs.data(), strip.ys.data(), closest);
+	}
+}
+
+
+/**
+ *	@brief	Divide and conquer search that works on the range [lo, hi) of the presorted arrays.
+ *	
+ *	This is the same algorithm as divideClosetPointSearch, but instead of copying the halves into
+ *	new vectors at every level, the recursion only moves the bounds.  Q[lo, hi) is partitioned in
+ *	place into the points that belong to P[lo, mid) and P[mid, hi), keeping the y order.  Once both
+ *	halves return, they are merged back by y so the caller sees Q[lo, hi) sorted again.  S is the
+ *	scratch buffer, it must be as large as Q and is only ever touched inside [lo, hi).
+ *	
+ *	@param P		Points sorted by x
+ *	@param Q		Points sorted by y, with a pointer to their copy in P
+ *	@param S		Scratch space for partitioning, merging and building the strip of non int types
+ *	@param strip	Room for the strips of int types, as large as Q
+ *	@param lo		First index of the range
+ *	@param hi		One past the last index of the range
+ *	@param closest	A copy of the two closest points will be stored in closest
+ *	
+ *	@return The squared distance between the two closest points in the range.
+ */
+template<class T>
+typename CoordTraits<T>::Dist divideClosestRangeSearch(const BasicPoint<T>* P, pair<BasicPoint<T>, const BasicPoint<T>*>* Q, pair<BasicPoint<T>, const BasicPoint<T>*>* S, StripBuffer& strip, size_t lo, size_t hi, pair<BasicPoint<T>, BasicPoint<T>>& closest)
+{
+	typedef typename CoordTraits<T>::Dist Dist;
+
+	STAT_CALL();
+
+	// Range is small enough, just bruteforce it
+	if(hi - lo <= size_t(selected_cutoff))
+	{
+		STAT_ADD(baseCases, 1);
+		return bruteForceClosestPair(P + lo, hi - lo, closest);
+	}
+
+	size_t m = lo + (hi - lo)/2;
+	T mid = P[m].x;
+
+	// Split Q by where its point lives in P, this stays correct even when x values repeat
+	size_t l = lo;
+	size_t r = m;
+	for(size_t i = lo; i < hi; i++)
+	{
+		if(Q[i].second < P + m)
+			S[l++] = Q[i];
+		else
+			S[r++] = Q[i];
+	}
+	for(size_t i = lo; i < hi; i++)
+		Q[i] = S[i];
+
+	// Find the closest pair on the left
+	pair<BasicPoint<T>, BasicPoint<T>> cl{P[lo], P[lo+1]};
+	Dist dl = divideClosestRangeSearch(P, Q, S, strip, lo, m, cl);
+
+	// Find the closest pair on the right
+	pair<BasicPoint<T>, BasicPoint<T>> cr{P[m], P[m+1]};
+	Dist dr = divideClosestRangeSearch(P, Q, S, strip, m, hi, cr);
+
+	// Find the closest of the two
+	Dist d;
+	if( dl < dr)
+	{
+		closest = cl;
+		d = dl;
+	}
+	else
+	{
+		closest = cr;
+		d = dr;
+	}
+
+	// Both halves are sorted by y again, merge them back together through S
+	mergeByY(Q, S, lo, m, hi);
+	copy(S + lo, S + hi, Q + lo);
+
+	return closestInStrip(Q + lo, hi - lo, mid, d, S + lo, strip, lo, closest);
+}
+
+
+/**
+ *	@brief	Using a divide an conquer algorith, find the closest points and the distance between them.
+ *	
+ *	This purpose of this function is not to run the algorith but to set up the data structures
+ *	that will allow it to be run more efficiently.  The points in the dataset will be first copied into
+ *	a new vector, P, and sorted by their X component.  Thos points are then copied into a new vector,
+ *	Q, which is sorted by the Y component.  Both sorts use selected_sort, radix by default.  The trick to making it work, is that the points in Q keep
+ *	a pointer to their matching point in P.  This allows us to only sort the points a single time, but still
+ *	correctly distribute for the algorithm.
+ *	
+ *	When inPlace is set, a single scratch buffer the size of Q is allocated here, along with the
+ *	strip space, and the search runs on index ranges of P and Q, so the recursion itself never
+ *	touches the heap.  If the points are also already sorted by x (like a sorted binary point
+ *	file) they are used as P directly and are never copied.  The in place search does not write
+ *	to P.  Without inPlace the search copies the halves of P at every level, so P is always a copy.
+ *	
+ *	@param points		Points to find the closest pair in.
+ *	@param n			Number of points
+ *	@param closestPair	A copy of the two closest points will be stored in closest pair
+ *	@param inPlace		Use divideClosestRangeSearch instead of divideClosetPointSearch
+ *	@param sortedByX	The points are already sorted by x
+ *	
+ *	@return The squared distance between the two closest points.
+ */
+long long divideClosestPoint( const Point* points, size_t n, pair<Point, Point>& closestPair, bool inPlace = false, bool sortedByX = false )
+{
+	//copy points into P and sort by X, unless the search can use them as they are
+	vector< Point> copyP;
+	const Point* P = points;
+	if( !inPlace || !sortedByX )
+	{
+		copyP.assign(points, points + n);
+		if( !sortedByX )
+			sortByX(copyP);
+		P = copyP.data();
+	}
+
+	
+	//copy points from P into Q with a pointer to the value in P
+	vector<pair<Point, const Point*>> Q;
+	Q.reserve(n);
+	for( size_t i = 0; i < n; i++)
+		Q.emplace_back(P[i], &P[i]);
+
+	//sort Q by Y
+	sortByY(Q);
+	
+
+	// Do the actual search, the strip space goes away with it
+	StripBuffer strip(n);
+	if( inPlace )
+	{
+		vector<pair<Point, const Point*>> S = Q;
+		return divideClosestRangeSearch(P, Q.data(), S.data(), strip, 0, n, closestPair);
+	}
+	return divideClosetPointSearch(copyP, P, Q, strip, closestPair);
+}
+
+/**
+ *	@brief	Using a divide an conquer algorith, find the closest points in a vector.
+ *	
+ *	@param points		Vector of Points to find the closest pair in.
+ *	@param closestPair	A copy of the two closest points will be stored in closest pair
+ *	@param inPlace		Use divideClosestRangeSearch instead of divideClosetPointSearch
+ *	
+ *	@return The squared distance between the two closest points.
+ */
+long long divideClosestPoint( vector<Point>& points, pair<Point, Point>& closestPair, bool inPlace = false )
+{
+	return divideClosestPoint(points.data(), points.size(), closestPair, inPlace);
+}
+
+
+/**
+ *	@brief	Divide and conquer that builds the y order as it returns (Preparata and Shamos).
+ *	
+ *	There is no Q.  A[lo, hi) comes in sorted by x and leaves sorted by y: the base case sorts
+ *	its few points by y, and every level merges its two y sorted halves through S once both
+ *	have returned.  The strip is then compacted out of the merged range by closestInStrip.  So the only
+ *	presort is by x, the entries are 8 byte points, and nothing is partitioned on the way down.
+ *	
+ *	@param A		Points, sorted by x on entry, sorted by y on return
+ *	@param S		Scratch space as large as A, only touched inside [lo, hi)
+ *	@param strip	Room for the strips, as large as A
+ *	@param lo		First index of the range
+ *	@param hi		One past the last index of the range
+ *	@param closest	A copy of the two closest points will be stored in closest
+ *	
+ *	@return The squared distance between the two closest points in the range.
+ */
+long long shamosClosestSearch(Point* A, Point* S, StripBuffer& strip, size_t lo, size_t hi, pair<Point, Point>& closest)
+{
+	STAT_CALL();
+
+	// Range is small enough, bruteforce it and leave it sorted by y
+	if(hi - lo <= size_t(selected_cutoff))
+	{
+		STAT_ADD(baseCases, 1);
+		long long best = bruteForceClosestPair(A + lo, hi - lo, closest);
+		insertionSortByY(A, lo, hi);
+		return best;
+	}
+
+	// The split has to be read before the halves reorder themselves by y
+	size_t m = lo + (hi - lo)/2;
+	int mid = A[m].x;
+
+	pair<Point, Point> cl{A[lo], A[lo+1]};
+	long long dl = shamosClosestSearch(A, S, strip, lo, m, cl);
+
+	pair<Point, Point> cr{A[m], A[m+1]};
+	long long dr = shamosClosestSearch(A, S, strip, m, hi, cr);
+
+	long long d;
+	if( dl < dr)
+	{
+		closest = cl;
+		d = dl;
+	}
+	else
+	{
+		closest = cr;
+		d = dr;
+	}
+
+	// Merge the y sorted halves through S
+	mergeByY(A, S, lo, m, hi);
+	copy(S + lo, S + hi, A + lo);
+
+	return closestInStrip(A + lo, hi - lo, mid, d, strip.xs.data() + lo, strip.ys.data() + lo, closest);
+}
+
+
+/**
+ *	@brief	Find the closest pair with the single presort divide and conquer.
+ *	
+ *	@param points		Points to find the closest pair in.
+ *	@param n			Number of points
+ *	@param closestPair	A copy of the two closest points will be stored in closest pair
+ *	@param sortedByX	The points are already sorted by x, so the presort is skipped
+ *	
+ *	@return The squared distance between the two closest points.
+ */
+long long shamosClosestPoint( const Point* points, size_t n, pair<Point, Point>& closestPair, bool sortedByX = false )
+{
+	// The search reorders its input, so it always works on a copy
+	vector<Point> A(points, points + n);
+	if( !sortedByX )
+		sortByX(A);
+
+	vector<Point> S(A);
+	StripBuffer strip(n);
+	return shamosClosestSearch(A.data(), S.data(), strip, 0, n, closestPair);
+}
+
+/**
+ *	@brief	Find the closest pair in a vector with the single presort divide and conquer.
+ *	
+ *	@param points		Vector of Points to find the closest pair in.
+ *	@param closestPair	A copy of the two closest points will be stored in closest pair
+ *	
+ *	@return The squared distance between the two closest points.
+ */
+long long shamosClosestPoint( vector<Point>& points, pair<Point, Point>& closestPair )
+{
+	return shamosClosestPoint(points.data(), points.size(), closestPair);
+}
+
+
+/**
+ *	@brief	Bottom up divide and conquer without recursion.
+ *	
+ *	The x sorted array is cut into blocks of the base case size, which are brute forced and sorted
+ *	by y.  Then level by level, neighbouring blocks of 2^k base blocks are merged by y from one
+ *	buffer into the other, and the strip around their boundary is compacted out of the merged
+ *	block and scanned.  The buffers swap roles every level, so nothing is copied
+ *	back.  The x value of every base block boundary is saved before the blocks are sorted by y,
+ *	since that is where the strips are centred.  One d is shared by the whole run: a strip only
+ *	has to find pairs closer than the best pair found anywhere so far, which also keeps the
+ *	strip's lookahead bound, since no two points of the same half are closer than d.
+ *	
+ *	Every level is a few linear passes over both buffers, the stack use does not depend on n, and
+ *	the indices are size_t so more than 2^31 points can be searched.
+ *	
+ *	@param A			Points sorted by x, reordered by the search
+ *	@param B			Second buffer as large as A
+ *	@param n			Number of points, at least 2
+ *	@param closestPair	A copy of the two closest points will be stored in closest pair
+ *	
+ *	@return The squared distance between the two closest points.
+ */
+long long iterativeClosestSearch(Point* A, Point* B, size_t n, pair<Point, Point>& closestPair)
+{
+	const size_t base = max(2, selected_cutoff);
+
+	// Centres of the strips, saved while the blocks are still in x order
+	vector<int> boundaryX((n + base - 1) / base);
+	for(size_t b = 0; b < boundaryX.size(); b++)
+		boundaryX[b] = A[b * base].x;
+
+	// Strips of the merged blocks, allocated once for every level
+	StripBuffer strip(n);
+
+	long long d = LLONG_MAX;
+	for(size_t lo = 0; lo < n; lo += base)
+	{
+		size_t hi = min(n, lo + base);
+		STAT_ADD(baseCases, 1);
+
+		pair<Point, Point> block{A[lo], A[lo]};
+		long long best = bruteForceClosestPair(A + lo, hi - lo, block);
+		if( best < d )
+		{
+			d = best;
+			closestPair = block;
+		}
+
+		insertionSortByY(A, lo, hi);
+	}
+
+	Point* from = A;
+	Point* to = B;
+	for(size_t width = base; width < n; width *= 2)
+	{
+		for(size_t lo = 0; lo < n; lo += 2 * width)
+		{
+			size_t m = min(n, lo + width);
+			size_t hi = min(n, lo + 2 * width);
+
+			// Merge the two y sorted blocks, a lone last block is just carried over
+			mergeByY(from, to, lo, m, hi);
+
+			if( m == hi )
+				continue;
+
+			d = closestInStrip(to + lo, hi - lo, boundaryX[m / base], d, strip.xs.data() + lo, strip.ys.data() + lo, closestPair);
+		}
+
+		swap(from, to);
+	}
+
+	return d;
+}
+
+
+/**
+ *	@brief	Find the closest pair with the bottom up divide and conquer.
+ *	
+ *	@param points		Points to find the closest pair in.
+ *	@param n			Number of points, at least 2
+ *	@param closestPair	A copy of the two closest points will be stored in closest pair
+ *	@param sortedByX	The points are already sorted by x, so the presort is skipped
+ *	
+ *	@return The squared distance between the two closest points.
+ */
+long long iterativeClosestPoint( const Point* points, size_t n, pair<Point, Point>& closestPair, bool sortedByX = false )
+{
+	vector<Point> A(points, points + n);
+	if( !sortedByX )
+		sortByX(A);
+
+	vector<Point> B(A);
+	return iterativeClosestSearch(A.data(), B.data(), n, closestPair);
+}
+
+/**
+ *	@brief	Find the closest pair in a vector with the bottom up divide and conquer.
+ *	
+ *	@param points		Vector of Points to find the closest pair in.
+ *	@param closestPair	A copy of the two closest points will be stored in closest pair
+ *	
+ *	@return The squared distance between the two closest points.
+ */
+long long iterativeClosestPoint( vector<Point>& points, pair<Point, Point>& closestPair )
+{
+	return iterativeClosestPoint(points.data(), points.size(), closestPair);
+}
+
+
+/**
+ *	@brief	In place divide and conquer over points of any coordinate type.
+ *	
+ *	This is the search divideClosestPoint runs when inPlace is set, with comparison sorts for the
+ *	presorts since the radix sort only takes int keys.
+ *	
+ *	@param points		Points to find the closest pair in.
+ *	@param n			Number of points, at least 2
+ *	@param closestPair	A copy of the two closest points will be stored in closest pair
+ *	
+ *	@return The squared distance between the two closest points.
+ */
+template<class T>
+typename CoordTraits<T>::Dist compactClosestPoint( const BasicPoint<T>* points, size_t n, pair<BasicPoint<T>, BasicPoint<T>>& closestPair )
+{
+	vector<BasicPoint<T>> P(points, points + n);
+	sort(P.begin(), P.end(), [](const BasicPoint<T>& a, const BasicPoint<T>& b){ return a.x < b.x; });
+
+	vector<pair<BasicPoint<T>, const BasicPoint<T>*>> Q;
+	Q.reserve(n);
+	for(size_t i = 0; i < n; i++)
+		Q.emplace_back(P[i], &P[i]);
+	sort(Q.begin(), Q.end(), [](const pair<BasicPoint<T>, const BasicPoint<T>*>& a, const pair<BasicPoint<T>, const BasicPoint<T>*>& b)
+	{
+		return a.first.y < b.first.y;
+	});
+
+	vector<pair<BasicPoint<T>, const BasicPoint<T>*>> S(Q);
+	StripBuffer strip(is_same<T, int>::value ? n : 0);
+	return divideClosestRangeSearch(P.data(), Q.data(), S.data(), strip, 0, n, closestPair);
+}
+
+
+//! A group of tasks that can be waited on together.
+struct TaskGroup
+{
+	atomic<int> pending{0};
+};
+
+//! Index of the pool worker running on this thread, the thread that owns the pool is 0.
+thread_local int WORKER_ID = 0;
+
+/**
+ *	A small work stealing thread pool for fork/join style recursion.
+ *	
+ *	Every worker owns a deque.  New tasks are pushed onto the back of the spawning worker's deque
+ *	and popped from the back by their owner, idle workers steal from the front of someone else's.
+ *	The thread that creates the pool takes part as worker 0 while it waits on a group, so a pool
+ *	of N threads starts N-1 new ones.  When the pool is destroyed the distance calcs and calls the
+ *	workers counted are added to the counters of the owning thread.
+ */
+class TaskPool
+{
+public:
+	explicit TaskPool(int threadCount)
+	{
+		threadCount = max(1, threadCount);
+		for(int i = 0; i < threadCount; i++)
+			workers.emplace_back(new Worker());
+
+		for(int i = 1; i < threadCount; i++)
+			threads.emplace_back(&TaskPool::workerLoop, this, i);
+	}
+
+	~TaskPool()
+	{
+		done = true;
+		sleep.notify_all();
+		for(auto& t : threads)
+			t.join();
+
+		STATS.add(workerStats);
+	}
+
+	int size() const
+	{
+		return workers.size();
+	}
+
+	/**
+	 *	@brief	Queue a task on the calling worker's deque.
+	 *	
+	 *	@param group	Group that will be told when the task finishes
+	 *	@param task		The work to run
+	 *	
+	 *	@return Void.
+	 */
+	void spawn(TaskGroup& group, function<void()> task)
+	{
+		group.pending++;
+		Worker& w = *workers[WORKER_ID];
+		{
+			lock_guard<mutex> guard(w.lock);
+			w.tasks.push_back({move(task), &group});
+		}
+		queued++;
+		sleep.notify_one();
+	}
+
+	/**
+	 *	@brief	Run or steal tasks until every task in the group has finished.
+	 *	
+	 *	After WAIT_SPINS failed steals in a row the thread sleeps until the group finishes or a new
+	 *	task is queued, instead of burning a core while the last tasks of the group run elsewhere.
+	 *	
+	 *	@param group	The group to wait on
+	 *	
+	 *	@return Void.
+	 */
+	void wait(TaskGroup& group)
+	{
+		int failed = 0;
+		while(group.pending > 0)
+		{
+			if(runOne(WORKER_ID))
+				failed = 0;
+			else if(++failed < WAIT_SPINS)
+				this_thread::yield();
+			else
+			{
+				unique_lock<mutex> guard(sleepLock);
+				sleep.wait_for(guard, chrono::milliseconds(1), [&]{ return group.pending == 0 || queued > 0; });
+			}
+		}
+	}
+
+private:
+	struct Task
+	{
+		function<void()> work;
+		TaskGroup* group;
+	};
+
+	struct Worker
+	{
+		mutex lock;
+		deque<Task> tasks;
+	};
+
+	// Pop from our own deque first, otherwise steal the oldest task from another worker
+	bool runOne(int self)
+	{
+		Task task;
+		bool found = false;
+
+		for(int i = 0; i < int(workers.size()) && !found; i++)
+		{
+			Worker& w = *workers[(self + i) % workers.size()];
+			lock_guard<mutex> guard(w.lock);
+			if(!w.tasks.empty())
+			{
+				if(i == 0)
+				{
+					task = move(w.tasks.back());
+					w.tasks.pop_back();
+				}
+				else
+				{
+					task = move(w.tasks.front());
+					w.tasks.pop_front();
+				}
+				found = true;
+			}
+		}
+
+		if(!found)
+			return false;
+
+		queued--;
+		task.work();
+
+		// The last task of a group wakes the thread waiting on it
+		if(--task.group->pending == 0)
+		{
+			lock_guard<mutex> guard(sleepLock);
+			sleep.notify_all();
+		}
+		return true;
+	}
+
+	void workerLoop(int self)
+	{
+		WORKER_ID = self;
+
+		while(!done)
+		{
+			if(!runOne(self))
+			{
+				unique_lock<mutex> guard(sleepLock);
+				sleep.wait_for(guard, chrono::milliseconds(1), [this]{ return done || queued > 0; });
+			}
+		}
+
+		lock_guard<mutex> guard(statsLock);
+		workerStats.add(STATS);
+	}
+
+	//! Failed steals in a row before a waiting thread goes to sleep
+	static const int WAIT_SPINS = 16;
+
+	vector<unique_ptr<Worker>> workers;
+	vector<thread> threads;
+	atomic<bool> done{false};
+	atomic<int> queued{0};
+	mutex statsLock;
+	Stats workerStats;
+	mutex sleepLock;
+	condition_variable sleep;
+};
+
+
+/**
+ *	@brief	Run body over [begin, end) in chunks of at least PARALLEL_GRAIN on the pool.
+ *	
+ *	@param pool		Pool to run the chunks on
+ *	@param begin	First index
+ *	@param end		One past the last index
+ *	@param body		Called as body(chunk, from, to) for every chunk
+ *	
+ *	@return The number of chunks that were used.
+ */
+int parallelChunks(TaskPool& pool, size_t begin, size_t end, const function<void(int, size_t, size_t)>& body)
+{
+	size_t n = end - begin;
+	int chunks = int(max<size_t>(1, min<size_t>(pool.size() * 4, n / PARALLEL_GRAIN)));
+
+	TaskGroup group;
+	for(int c = 1; c < chunks; c++)
+	{
+		size_t from = begin + n * c / chunks;
+		size_t to = begin + n * (c+1) / chunks;
+		pool.spawn(group, [&body, c, from, to]{ body(c, from, to); });
+	}
+	body(0, begin, begin + n / chunks);
+	pool.wait(group);
+
+	return chunks;
+}
+
+
+/**
+ *	@brief	Mergesort in parallel by forking the top levels of the recursion onto the pool.
+ *	
+ *	@param pool		Pool to fork onto
+ *	@param points	vector of points to sort
+ *	@param l		left bound of the sort
+ *	@param r		right bound of the sort
+ *	
+ *	@return Void.
+ */
+template<typename T>
+void parallelMergeSort(TaskPool& pool, vector<T>& points, long long l, long long r)
+{
+	if(r - l < PARALLEL_GRAIN)
+	{
+		mergeSort(points, l, r);
+		return;
+	}
+
+	long long mid = l+(r-l)/2;
+
+	TaskGroup group;
+	pool.spawn(group, [&pool, &points, l, mid]{ parallelMergeSort(pool, points, l, mid); });
+	parallelMergeSort(pool, points, mid+1, r);
+	pool.wait(group);
+
+	merge(points, l, mid, r);
+}
+
+
+/**
+ *	@brief	Parallel version of divideClosestRangeSearch.
+ *	
+ *	The left half is forked onto the pool while this thread does the right half.  The partition of Q,
+ *	the merge back by y and the building of the strip are split into chunks as well.  Below
+ *	PARALLEL_GRAIN it falls back to the serial search.  Every step produces exactly the same arrays as
+ *	the serial search, so the result is identical to it.
+ *	
+ *	@param pool		Pool to fork onto
+ *	@param P		Points sorted by x
+ *	@param Q		Points sorted by y, with a pointer to their copy in P
+ *	@param S		Scratch space, as large as Q
+ *	@param strip	Room for the strips, as large as Q
+ *	@param lo		First index of the range
+ *	@param hi		One past the last index of the range
+ *	@param closest	A copy of the two closest points will be stored in closest
+ *	
+ *	@return The squared distance between the two closest points in the range.
+ */
+long long parallelClosestRangeSearch(TaskPool& pool, const Point* P, pair<Point, const Point*>* Q, pair<Point, const Point*>* S, StripBuffer& strip, size_t lo, size_t hi, pair<Point, Point>& closest)
+{
+	if(hi - lo < size_t(2 * PARALLEL_GRAIN))
+		return divideClosestRangeSearch(P, Q, S, strip, lo, hi, closest);
+
+	STAT_CALL();
+
+	size_t m = lo + (hi - lo)/2;
+	int mid = P[m].x;
+	int chunkCount = pool.size() * 4;
+	vector<size_t> lefts(chunkCount + 1), rights(chunkCount + 1);
+
+	// Count the left points of every chunk, then scatter each chunk into its slot of S
+	int chunks = parallelChunks(pool, lo, hi, [&](int c, size_t from, size_t to)
+	{
+		size_t count = 0;
+		for(size_t i = from; i < to; i++)
+			count += Q[i].second < P + m;
+		lefts[c+1] = count;
+		rights[c+1] = (to - from) - count;
+	});
+	lefts[0] = lo;
+	rights[0] = m;
+	for(int c = 1; c <= chunks; c++)
+	{
+		lefts[c] += lefts[c-1];
+		rights[c] += rights[c-1];
+	}
+	parallelChunks(pool, lo, hi, [&](int c, size_t from, size_t to)
+	{
+		size_t l = lefts[c];
+		size_t r = rights[c];
+		for(size_t i = from; i < to; i++)
+		{
+			if(Q[i].second < P + m)
+				S[l++] = Q[i];
+			else
+				S[r++] = Q[i];
+		}
+	});
+	parallelChunks(pool, lo, hi, [&](int, size_t from, size_t to)
+	{
+		for(size_t i = from; i < to; i++)
+			Q[i] = S[i];
+	});
+
+	// Find the closest pair on each side, the left side on another thread
+	pair<Point, Point> cl{P[lo], P[lo+1]};
+	pair<Point, Point> cr{P[m], P[m+1]};
+	long long dl;
+	TaskGroup group;
+	pool.spawn(group, [&]{ dl = parallelClosestRangeSearch(pool, P, Q, S, strip, lo, m, cl); });
+	long long dr = parallelClosestRangeSearch(pool, P, Q, S, strip, m, hi, cr);
+	pool.wait(group);
+
+	// Find the closest of the two
+	long long d;
+	if( dl < dr)
+	{
+		closest = cl;
+		d = dl;
+	}
+	else
+	{
+		closest = cr;
+		d = dr;
+	}
+
+	// Merge the halves back by y.  Each chunk of the output finds where it starts in both halves
+	// with a binary search, so the chunks can be merged independently.
+	parallelChunks(pool, lo, hi, [&](int, size_t from, size_t to)
+	{
+		size_t o = from - lo;
+		size_t a = o > hi - m ? o - (hi - m) : 0;
+		size_t b = min(o, m - lo);
+		while(a < b)
+		{
+			size_t i = (a + b)/2;
+			size_t j = o - i;
+			if(j > 0 && Q[lo + i].first.y <= Q[m + j - 1].first.y)
+				a = i + 1;
+			else
+				b = i;
+		}
+
+		size_t i = lo + a;
+		size_t j = m + (o - a);
+		for(size_t k = from; k < to; k++)
+		{
+			if(j >= hi || (i < m && Q[i].first.y <= Q[j].first.y))
+				S[k] = Q[i++];
+			else
+				S[k] = Q[j++];
+		}
+	});
+	parallelChunks(pool, lo, hi, [&](int, size_t from, size_t to)
+	{
+		for(size_t i = from; i < to; i++)
+			Q[i] = S[i];
+	});
+
+	// Every chunk compacts its strip points into its own part of the strip space, which the
+	// compaction never writes past, then the parts are closed up
+	if( d <= 0 )
+		return d;
+	int stripLo, stripHi;
+	stripBounds(mid, d, stripLo, stripHi);
+	int* xs = strip.xs.data();
+	int* ys = strip.ys.data();
+	vector<size_t> first(chunkCount), kept(chunkCount);
+	chunks = parallelChunks(pool, lo, hi, [&](int c, size_t from, size_t to)
+	{
+		first[c] = from;
+		kept[c] = compactStrip(&Q[from].first.x, Q_STRIDE, to - from, stripLo, stripHi, xs + from, ys + from);
+	});
+	size_t size = 0;
+	for(int c = 0; c < chunks; c++)
+	{
+		memmove(xs + lo + size, xs + first[c], kept[c] * sizeof(int));
+		memmove(ys + lo + size, ys + first[c], kept[c] * sizeof(int));
+		size += kept[c];
+	}
+
+	// The strip is small, scan it here just like the serial search
+	return closestInPackedStrip(xs + lo, ys + lo, size, d, closest);
+}
+
+
+/**
+ *	@brief	Run the divide and conquer search on multiple threads.
+ *	
+ *	Does the same setup as divideClosestPoint, with the search forked onto a work stealing pool.
+ *	The presorts are forked as well when the merge sort is selected, the radix sort is a few
+ *	linear passes and runs on this thread.
+ *	
+ *	@param points		Points to find the closest pair in.
+ *	@param n			Number of points
+ *	@param closestPair	A copy of the two closest points will be stored in closest pair
+ *	@param threads		Number of threads to use, including the calling thread
+ *	@param sortedByX	The points are already sorted by x and are used as P without a copy
+ *	
+ *	@return The squared distance between the two closest points.
+ */
+long long parallelClosestPoint( const Point* points, size_t n, pair<Point, Point>& closestPair, int threads, bool sortedByX = false )
+{
+	TaskPool pool(threads);
+
+	//copy points into P and sort by X, unless they already are
+	vector< Point> copyP;
+	const Point* P = points;
+	if( !sortedByX )
+	{
+		copyP.assign(points, points + n);
+		if(selected_sort == RADIX_SORT)
+			sortByX(copyP);
+		else
+			parallelMergeSort(pool, copyP, 0, (long long)n-1);
+		P = copyP.data();
+	}
+
+	//copy points from P into Q with a pointer to the value in P
+	vector<pair<Point, const Point*>> Q;
+	Q.reserve(n);
+	for( size_t i = 0; i < n; i++)
+		Q.emplace_back(P[i], &P[i]);
+
+	//sort Q by Y
+	if(selected_sort == RADIX_SORT)
+		sortByY(Q);
+	else
+		parallelMergeSort(pool, Q, 0, (long long)Q.size()-1);
+
+	vector<pair<Point, const Point*>> S = Q;
+	StripBuffer strip(n);
+	return parallelClosestRangeSearch(pool, P, Q.data(), S.data(), strip, 0, n, closestPair);
+}
+
+/**
+ *	@brief	Run the divide and conquer search on a vector on multiple threads.
+ *	
+ *	@param points		Vector of Points to find the closest pair in.
+ *	@param closestPair	A copy of the two closest points will be stored in closest pair
+ *	@param threads		Number of threads to use, including the calling thread
+ *	
+ *	@return The squared distance between the two closest points.
+ */
+long long parallelClosestPoint( vector<Point>& points, pair<Point, Point>& closestPair, int threads )
+{
+	return parallelClosestPoint(points.data(), points.size(), closestPair, threads);
+}
+
+
+/**
+ *	@brief	Floor division that rounds towards negative infinity for negative coordinates too.
+ *	
+ *	@param v	Value to divide
+ *	@param s	Positive divisor
+ *	
+ *	@return floor(v / s)
+ */
+inline long long floorDiv(long long v, long long s)
+{
+	return v >= 0 ? v / s : -((-v + s - 1) / s);
+}
+
+/**
+ *	@brief	Hash a grid cell into a table with a power of two size.
+ *	
+ *	@param cx	Cell column
+ *	@param cy	Cell row
+ *	@param mask	Table size - 1
+ *	
+ *	@return The bucket of the cell.
+ */
+inline unsigned cellBucket(long long cx, long long cy, unsigned long long mask)
+{
+	unsigned long long h = (unsigned long long)cx * 0x9E3779B97F4A7C15ull ^ (unsigned long long)cy * 0xC2B2AE3D27D4EB4Full;
+	return unsigned((h ^ (h >> 29)) & mask);
+}
+
+/**
+ *	@brief	Smallest whole grid cell width that is at least sqrt(dsq).
+ *	
+ *	@param dsq	Squared distance
+ *	
+ *	@return ceil(sqrt(dsq)), at least 1.
+ */
+inline long long cellWidth(long long dsq)
+{
+	long long width = (long long)sqrt(double(dsq));
+	while( width * width < dsq )
+		width++;
+	while( width > 1 && (width - 1) * (width - 1) >= dsq )
+		width--;
+	return max(1ll, width);
+}
+
+/**
+ *	@brief	Draw the sample the grid methods estimate d from, about n^(2/3) distinct points.
+ *	
+ *	The indices are picked with Floyd's algorithm, one draw per sampled point and only the picked
+ *	indices kept, so the memory is O(n^(2/3)) rather than a permutation of all n.
+ *	
+ *	@param points	Points to draw from
+ *	@param n		Number of points, at least 2
+ *	@param seed		Seed for the sample, the same seed always draws the same points
+ *	
+ *	@return The sample, at least 2 points.
+ */
+template<class P>
+vector<P> gridSample(const P* points, size_t n, unsigned long long seed)
+{
+	mt19937_64 rng(seed);
+	size_t m = max<size_t>(2, min(n, size_t(pow(double(n), 2.0/3.0))));
+
+	// Pick from [0, j] for the last m values of j, taking j itself when the pick was already taken
+	unordered_set<size_t> picked;
+	picked.reserve(m);
+	vector<P> sample;
+	sample.reserve(m);
+	for(size_t j = n - m; j < n; j++)
+	{
+		size_t t = size_t(rng() % (unsigned long long)(j + 1));
+		if( !picked.insert(t).second )
+		{
+			t = j;
+			picked.insert(t);
+		}
+		sample.push_back(points[t]);
+	}
+
+	return sample;
+}
+
+/**
+ *	@brief	Find the closest pair with the randomized grid method in O(n) expected time.
+ *	
+ *	A random sample of about n^(2/3) distinct points is solved with the in place divide and conquer.
+ *	Its closest distance d can never be smaller than the real answer, so every pair that could beat
+ *	it lies in the same or a neighbouring cell of a grid with cells d wide.  The points are bucketed
+ *	into a hashed grid (counting sort by bucket) and each point is only checked against the 9 cells
+ *	around it.  The sample keeps the expected number of points per cell constant.
+ *	
+ *	@param points		Points to find the closest pair in, they are only read
+ *	@param n			Number of points
+ *	@param closestPair	A copy of the two closest points will be stored in closest pair
+ *	@param seed			Seed for the sample, the same seed always gives the same pair
+ *	
+ *	@return The squared distance between the two closest points.
+ */
+long long gridClosestPoint( const Point* points, size_t n, pair<Point, Point>& closestPair, unsigned long long seed )
+{
+	if( n <= size_t(KERNEL_STACK_POINTS) )
+		return bruteForceClosestPair(points, n, closestPair);
+
+	// Estimate d from a sample of distinct points
+	vector<Point> sample = gridSample(points, n, seed);
+	long long best = divideClosestPoint(sample, closestPair, true);
+	if( best == 0 )
+		return 0;
+
+	// Cells must be at least sqrt(best) wide so a closer pair is never more than one cell apart
+	long long cell = cellWidth(best);
+
+	unsigned long long tableSize = 1;
+	while( tableSize < 2ull * n )
+		tableSize <<= 1;
+	unsigned long long mask = tableSize - 1;
+
+	// Bucket the points by the hash of their cell
+	vector<long long> cx(n), cy(n);
+	vector<unsigned> bucket(n);
+	vector<size_t> start(tableSize + 1, 0);
+	for(size_t i = 0; i < n; i++)
+	{
+		cx[i] = floorDiv(points[i].x, cell);
+		cy[i] = floorDiv(points[i].y, cell);
+		bucket[i] = cellBucket(cx[i], cy[i], mask);
+		start[bucket[i] + 1]++;
+	}
+	for(unsigned long long b = 1; b <= tableSize; b++)
+		start[b] += start[b-1];
+
+	vector<size_t> order(n);
+	vector<size_t> next(start.begin(), start.end() - 1);
+	for(size_t i = 0; i < n; i++)
+		order[next[bucket[i]]++] = i;
+
+	// Check every point against the 9 cells around it
+	long long calcs = 0;
+	for(size_t i = 0; i < n; i++)
+	{
+		for(int ox = -1; ox <= 1; ox++)
+		{
+			for(int oy = -1; oy <= 1; oy++)
+			{
+				long long nx = cx[i] + ox;
+				long long ny = cy[i] + oy;
+				unsigned b = cellBucket(nx, ny, mask);
+
+				for(size_t k = start[b]; k < start[b+1]; k++)
+				{
+					size_t j = order[k];
+					if( j <= i || cx[j] != nx || cy[j] != ny )
+						continue;
+
+					calcs++;
+					long long dist = distSquared(points[i], points[j]);
+					if( dist < best )
+					{
+						best = dist;
+						closestPair.first = points[i];
+						closestPair.second = points[j];
+					}
+				}
+			}
+		}
+	}
+	STAT_ADD(distanceCalcs, calcs);
+
+	return best;
+}
+
+/**
+ *	@brief	Find the closest pair in a vector with the randomized grid method.
+ *	
+ *	@param points		Vector of Points to find the closest pair in.
+ *	@param closestPair	A copy of the two closest points will be stored in closest pair
+ *	@param seed			Seed for the sample
+ *	
+ *	@return The squared distance between the two closest points.
+ */
+long long gridClosestPoint( vector<Point>& points, pair<Point, Point>& closestPair, unsigned long long seed )
+{
+	return gridClosestPoint(points.data(), points.size(), closestPair, seed);
+}
+
+
+/**
+ *	@brief	Find the closest pair with a plane sweep.
+ *	
+ *	The points are sorted by x and swept from left to right.  The active set holds the points that
+ *	are less than d to the left of the sweep line, ordered by y, so each new point only looks at the
+ *	ones inside the 2d tall band around its own y.  There is no recursion and nothing is copied
+ *	per level, the sorted points are walked once.
+ *	
+ *	@param points		Points to find the closest pair in, they are only read
+ *	@param n			Number of points
+ *	@param closestPair	A copy of the two closest points will be stored in closest pair
+ *	@param sortedByX	The points are already sorted by x and are swept without a copy
+ *	
+ *	@return The squared distance between the two closest points.
+ */
+long long sweepClosestPoint( const Point* points, size_t n, pair<Point, Point>& closestPair, bool sortedByX = false )
+{
+	if( n < 2 )
+		return LLONG_MAX;
+
+	vector<Point> copyP;
+	const Point* P = points;
+	if( !sortedByX )
+	{
+		copyP.assign(points, points + n);
+		sortByX(copyP);
+		P = copyP.data();
+	}
+
+	// Active points keyed by (y, index into P) so repeated points stay distinct
+	set<pair<int, size_t>> active;
+	long long best = LLONG_MAX;
+	long long band = LLONG_MAX;
+	long long calcs = 0;
+	size_t left = 0;
+
+	for(size_t i = 0; i < n; i++)
+	{
+		// Drop points that are too far left to beat best
+		while( left < i && sq(P[i].x - (long long)P[left].x) >= best )
+		{
+			active.erase({P[left].y, left});
+			left++;
+		}
+
+		// Only the points with |dy| <= band can be closer than best
+		long long low = band == LLONG_MAX ? INT_MIN : max<long long>(INT_MIN, P[i].y - band);
+		for(auto it = active.lower_bound({int(low), 0}); it != active.end(); ++it)
+		{
+			long long dy = it->first - (long long)P[i].y;
+			if( dy > 0 && sq(dy) >= best )
+				break;
+
+			calcs++;
+			long long dist = distSquared(P[i], P[it->second]);
+			if( dist < best )
+			{
+				best = dist;
+				closestPair.first = P[it->second];
+				closestPair.second = P[i];
+
+				// Smallest whole band that still covers sqrt(best)
+				band = (long long)sqrt(double(best));
+				while( band * band < best )
+					band++;
+			}
+		}
+
+		active.insert({P[i].y, i});
+	}
+	STAT_ADD(distanceCalcs, calcs);
+
+	return best;
+}
+
+/**
+ *	@brief	Find the closest pair in a vector with a plane sweep.
+ *	
+ *	@param points		Vector of Points to find the closest pair in.
+ *	@param closestPair	A copy of the two closest points will be stored in closest pair
+ *	
+ *	@return The squared distance between the two closest points.
+ */
+long long sweepClosestPoint( vector<Point>& points, pair<Point, Point>& closestPair )
+{
+	return sweepClosestPoint(points.data(), points.size(), closestPair);
+}
+
+
+//! Highest dimension the D dimensional engines are instantiated for
+const int MAX_DIMENSION = 8;
+
+//! Largest coordinate magnitude of a PointND, so the squared distance of up to MAX_DIMENSION of them fits a long long
+const int MAX_COORD_ND = (1 << 28) - 1;
+
+/**
+ *	A point with D int coordinates.  The coordinates must be within MAX_COORD_ND, so the squared
+ *	distance of up to MAX_DIMENSION of them still fits a long long.
+ */
+template<int D>
+struct PointND
+{
+	int c[D];
+};
+
+/**
+ *	@brief		Calculate the exact squared Euclidean distance between two D dimensional points.
+ *	
+ *	@param a	Point A
+ *	@param b	Point B
+ *	
+ *	@return The squared distance between A and B
+ */
+template<int D>
+inline long long distSquared( const PointND<D>& a, const PointND<D>& b)
+{
+	long long sum = 0;
+	for(int i = 0; i < D; i++)
+	{
+		long long d = (long long)a.c[i] - b.c[i];
+		sum += d*d;
+	}
+	return sum;
+}
+
+
+/**
+ *	@brief	Using brute force, calculate the two closest D dimensional points.
+ *	
+ *	@param points		Pointer to the first point of the range.
+ *	@param n			Number of points in the range.
+ *	@param closestPair	Will contain a copy of the two closest points.
+ *	
+ *	@return The squared distance between the two closest points, LLONG_MAX if n < 2.
+ */
+template<int D>
+long long bruteForceClosestPair( const PointND<D>* points, size_t n, pair<PointND<D>, PointND<D>>& closestPair)
+{
+	long long best = LLONG_MAX;
+	for(size_t i = 0; i < n; i++)
+	{
+		for(size_t j = i+1; j < n; j++)
+		{
+			long long dist = distSquared(points[i], points[j]);
+			if( dist < best )
+			{
+				best = dist;
+				closestPair.first = points[i];
+				closestPair.second = points[j];
+			}
+		}
+	}
+	STAT_ADD(distanceCalcs, (long long)n*(n-1)/2);
+
+	return best;
+}
+
+
+/**
+ *	@brief	Divide and conquer search over D dimensional points on the range [lo, hi) (Bentley).
+ *	
+ *	Only pairs closer than d are looked for.  The range is split at the median of coordinate
+ *	axis and both halves are searched.  A closer pair across the split then has both points
+ *	within d of it in that coordinate, so those points form the slab, and the slab is searched
+ *	the same way on the next coordinate, with one dimension less to split.  The slab of the last
+ *	coordinate is sorted by it and scanned like the 2D strip.  Points that all land in the slab,
+ *	like points that share the first coordinate, only push the work down one dimension instead
+ *	of into a quadratic scan, so the search runs in O(n log^(D-1) n).
+ *	
+ *	The points of the range are reordered by the search.
+ *	
+ *	@param A		The points
+ *	@param lo		First index of the range
+ *	@param hi		One past the last index of the range
+ *	@param axis		Coordinate to split on, the callers already split on the ones before it
+ *	@param d		Only pairs closer than this are looked for
+ *	@param closest	Set to the closest pair in the range if it is closer than d
+ *	
+ *	@return The squared distance of the closest pair in the range if it is below d, otherwise d.
+ */
+template<int D>
+long long divideClosestSearchND(PointND<D>* A, size_t lo, size_t hi, int axis, long long d, pair<PointND<D>, PointND<D>>& closest)
+{
+	auto byAxis = [axis](const PointND<D>& a, const PointND<D>& b){ return a.c[axis] < b.c[axis]; };
+	STAT_CALL();
+
+	if( hi - lo <= 3 )
+	{
+		STAT_ADD(baseCases, 1);
+		pair<PointND<D>, PointND<D>> found = closest;
+		long long best = bruteForceClosestPair(A + lo, hi - lo, found);
+		if( best < d )
+		{
+			d = best;
+			closest = found;
+		}
+		return d;
+	}
+
+	// Nothing is left to split on, scan the slab in order of the last coordinate
+	if( axis == D - 1 )
+	{
+		sort(A + lo, A + hi, byAxis);
+		long long compared = 0;
+		for(size_t i = lo; i < hi; i++)
+		{
+			for(size_t k = i+1; k < hi && sq((long long)A[k].c[axis] - A[i].c[axis]) < d; k++)
+			{
+				compared++;
+				long long dist = distSquared(A[i], A[k]);
+				if( dist < d )
+				{
+					d = dist;
+					closest.first = A[i];
+					closest.second = A[k];
+				}
+			}
+		}
+		STAT_STRIP(hi - lo, compared);
+		return d;
+	}
+
+	// A coordinate the range does not vary in has nothing to split, all of it would be the slab
+	auto spread = minmax_element(A + lo, A + hi, byAxis);
+	if( spread.first->c[axis] == spread.second->c[axis] )
+		return divideClosestSearchND(A, lo, hi, axis + 1, d, closest);
+
+	size_t m = lo + (hi - lo)/2;
+	nth_element(A + lo, A + m, A + hi, byAxis);
+	int mid = A[m].c[axis];
+
+	d = divideClosestSearchND(A, lo, m, axis, d, closest);
+	d = divideClosestSearchND(A, m, hi, axis, d, closest);
+
+	// Move the points within d of the split to the front of the range, they form the slab
+	PointND<D>* slab = partition(A + lo, A + hi, [&](const PointND<D>& p){ return sq((long long)p.c[axis] - mid) < d; });
+	return divideClosestSearchND(A, lo, size_t(slab - A), axis + 1, d, closest);
+}
+
+
+/**
+ *	@brief	Find the closest pair of D dimensional points with divide and conquer.
+ *	
+ *	@param points		Points to search
+ *	@param n			Number of points, at least 2
+ *	@param closestPair	A copy of the two closest points will be stored in closest pair
+ *	
+ *	@return The squared distance between the two closest points.
+ */
+template<int D>
+long long divideClosestPoint( const PointND<D>* points, size_t n, pair<PointND<D>, PointND<D>>& closestPair )
+{
+	// The search reorders its input, so it works on a copy
+	vector<PointND<D>> A(points, points + n);
+
+	closestPair = {A[0], A[1]};
+	return divideClosestSearchND(A.data(), 0, n, 0, LLONG_MAX, closestPair);
+}
+
+
+/**
+ *	@brief	Find the closest pair of D dimensional points with the randomized grid method.
+ *	
+ *	The same method as gridClosestPoint.  The distance of a sample of n^(2/3) points sets the
+ *	cell width, and the points are bucketed by the hash of their D cell coordinates.  A closer
+ *	pair is then at most one cell apart in every coordinate.  Each point is checked against its
+ *	own cell and the half of the 3^D - 1 neighbour cells whose first non zero offset is positive,
+ *	the other half sees it from the other side.  Unlike the divide and conquer, the work per
+ *	point does not grow by a log factor with every dimension.
+ *	
+ *	@param points		Points to search
+ *	@param n			Number of points, at least 2
+ *	@param closestPair	A copy of the two closest points will be stored in closest pair
+ *	@param seed			Seed for the sample
+ *	
+ *	@return The squared distance between the two closest points.
+ */
+template<int D>
+long long gridClosestPoint( const PointND<D>* points, size_t n, pair<PointND<D>, PointND<D>>& closestPair, unsigned long long seed )
+{
+	if( n <= KERNEL_STACK_POINTS )
+		return bruteForceClosestPair(points, n, closestPair);
+
+	// Estimate d from a sample of distinct points
+	vector<PointND<D>> sample = gridSample(points, n, seed);
+	long long best = divideClosestPoint(sample.data(), sample.size(), closestPair);
+	if( best == 0 )
+		return 0;
+
+	long long cell = cellWidth(best);
+
+	unsigned long long tableSize = 1;
+	while( tableSize < 2ull * n )
+		tableSize <<= 1;
+	unsigned long long mask = tableSize - 1;
+
+	auto hashCell = [mask](const long long* cc)
+	{
+		unsigned long long h = 0;
+		for(int k = 0; k < D; k++)
+			h = (h ^ (unsigned long long)cc[k]) * 0x9E3779B97F4A7C15ull;
+		return unsigned((h ^ (h >> 29)) & mask);
+	};
+
+	// Bucket the points by the hash of their cell
+	vector<long long> cells((size_t)n * D);
+	vector<unsigned> bucket(n);
+	vector<size_t> start(tableSize + 1, 0);
+	for(size_t i = 0; i < n; i++)
+	{
+		for(int k = 0; k < D; k++)
+			cells[i*D + k] = floorDiv(points[i].c[k], cell);
+		bucket[i] = hashCell(&cells[i*D]);
+		start[bucket[i] + 1]++;
+	}
+	for(unsigned long long b = 1; b <= tableSize; b++)
+		start[b] += start[b-1];
+
+	vector<size_t> order(n);
+	vector<size_t> next(start.begin(), start.end() - 1);
+	for(size_t i = 0; i < n; i++)
+		order[next[bucket[i]]++] = i;
+
+	// The offsets to check, the zero offset first and then the forward half of the neighbours
+	vector<array<int, D>> offsets;
+	int total = 1;
+	for(int k = 0; k < D; k++)
+		total *= 3;
+	for(int code = 0; code < total; code++)
+	{
+		array<int, D> o;
+		int rest = code;
+		int firstNonZero = 0;
+		for(int k = 0; k < D; k++)
+		{
+			o[k] = rest % 3 - 1;
+			rest /= 3;
+			if( firstNonZero == 0 )
+				firstNonZero = o[k];
+		}
+		if( firstNonZero == 0 )
+			offsets.insert(offsets.begin(), o);
+		else if( firstNonZero > 0 )
+			offsets.push_back(o);
+	}
+
+	long long calcs = 0;
+	long long target[D];
+	for(size_t i = 0; i < n; i++)
+	{
+		const long long* own = &cells[i*D];
+		for(size_t o = 0; o < offsets.size(); o++)
+		{
+			for(int k = 0; k < D; k++)
+				target[k] = own[k] + offsets[o][k];
+			unsigned b = hashCell(target);
+
+			for(size_t t = start[b]; t < start[b+1]; t++)
+			{
+				size_t j = order[t];
+				if( o == 0 && j <= i )
+					continue;
+				if( !equal(target, target + D, &cells[j*D]) )
+					continue;
+
+				calcs++;
+				long long dist = distSquared(points[i], points[j]);
+				if( dist < best )
+				{
+					best = dist;
+					closestPair.first = points[i];
+					closestPair.second = points[j];
+				}
+			}
+		}
+	}
+	STAT_ADD(distanceCalcs, calcs);
+
+	return best;
+}
+
+
+//! A pair of points and their squared distance, ordered by the distance
+struct ClosePair
+{
+	long long dist;
+	Point a;
+	Point b;
+
+	bool operator<(const ClosePair& other) const
+	{
+		return dist < other.dist;
+	}
+};
+
+//! A point with its position in the x sorted order, used to tell the two halves apart
+struct RankedPoint
+{
+	Point p;
+	size_t rank;
+};
+
+inline int yOf(const RankedPoint& r)
+{
+	return r.p.y;
+}
+
+//! The k closest pairs found so far, the worst one on top
+typedef priority_queue<ClosePair> TopKHeap;
+
+/**
+ *	@brief	Offer a pair to the top k heap.
+ *	
+ *	@return Void.
+ */
+inline void offerPair(TopKHeap& heap, int k, long long dist, const Point& a, const Point& b)
+{
+	if( int(heap.size()) < k )
+	{
+		heap.push({dist, a, b});
+	}
+	else if( dist < heap.top().dist )
+	{
+		heap.pop();
+		heap.push({dist, a, b});
+	}
+}
+
+/**
+ *	@brief	Divide and conquer search for the k closest pairs in A[lo, hi).
+ *	
+ *	Works like the divide and conquer search, but the pruning distance is the k-th best distance
+ *	found so far instead of the best one.  A[lo, hi) comes in sorted by x and is returned sorted by y,
+ *	the halves are merged as the recursion returns.  The strip only compares points from different
+ *	halves, the pairs inside a half were already offered by the recursion, so no pair is offered twice.
+ *	
+ *	@param A		Points with their x rank, sorted by x on the way in
+ *	@param S		Scratch space as large as A
+ *	@param lo		First index of the range
+ *	@param hi		One past the last index of the range
+ *	@param k		Number of pairs to keep
+ *	@param seed		Any pair at this distance or closer may be needed until the heap is full
+ *	@param heap		The best k pairs so far
+ *	
+ *	@return Void.
+ */
+void topKSearch(RankedPoint* A, RankedPoint* S, size_t lo, size_t hi, int k, long long seed, TopKHeap& heap)
+{
+	STAT_CALL();
+
+	// Pairs closer than limit can still make it into the heap
+	auto limit = [&]() { return int(heap.size()) < k ? seed : heap.top().dist - 1; };
+
+	if( hi - lo <= 3 )
+	{
+		for(size_t i = lo; i < hi; i++)
+		{
+			for(size_t j = i+1; j < hi; j++)
+			{
+				STAT_ADD(distanceCalcs, 1);
+				long long dist = distSquared(A[i].p, A[j].p);
+				if( dist <= limit() )
+					offerPair(heap, k, dist, A[i].p, A[j].p);
+			}
+		}
+
+		// Leave the range sorted by y
+		insertionSortByY(A, lo, hi);
+		return;
+	}
+
+	size_t m = lo + (hi - lo)/2;
+	int mid = A[m].p.x;
+	size_t midRank = A[m].rank;
+
+	topKSearch(A, S, lo, m, k, seed, heap);
+	topKSearch(A, S, m, hi, k, seed, heap);
+
+	// Merge the halves by y
+	mergeByY(A, S, lo, m, hi);
+	copy(S + lo, S + hi, A + lo);
+
+	// Build the strip and compare points across the middle
+	long long bound = limit();
+	size_t size = lo;
+	for(size_t o = lo; o < hi; o++)
+	{
+		if( sq(A[o].p.x - mid) <= bound )
+			S[size++] = A[o];
+	}
+
+	for(size_t i = lo; i < size; i++)
+	{
+		bool left = S[i].rank < midRank;
+		for(size_t j = i+1; j < size && sq(S[j].p.y - S[i].p.y) <= limit(); j++)
+		{
+			if( (S[j].rank < midRank) == left )
+				continue;
+
+			STAT_ADD(distanceCalcs, 1);
+			long long dist = distSquared(S[i].p, S[j].p);
+			if( dist <= limit() )
+				offerPair(heap, k, dist, S[i].p, S[j].p);
+		}
+	}
+}
+
+/**
+ *	@brief	Find the k closest pairs of points.
+ *	
+ *	Before the search, the k-th smallest distance between neighbours in x order gives a bound that
+ *	the real k-th distance can not be above, so the search prunes from the start instead of comparing
+ *	everything while the heap fills up.  Runs in O(n log n) plus the pairs that are near the bound.
+ *	
+ *	@param points	Points to search
+ *	@param n		Number of points
+ *	@param k		Number of pairs wanted
+ *	
+ *	@return Up to k pairs, closest first.
+ */
+vector<ClosePair> topKClosestPairs(const Point* points, size_t n, int k)
+{
+	vector<ClosePair> result;
+	if( n < 2 || k <= 0 )
+		return result;
+
+	vector<Point> P(points, points + n);
+	sortByX(P);
+
+	// k distinct pairs at most this far apart already exist
+	long long seed = LLONG_MAX;
+	if( size_t(k) <= n - 1 )
+	{
+		vector<long long> gaps(n - 1);
+		for(size_t i = 0; i + 1 < n; i++)
+			gaps[i] = distSquared(P[i], P[i+1]);
+		nth_element(gaps.begin(), gaps.begin() + (k - 1), gaps.end());
+		seed = gaps[k - 1];
+	}
+
+	vector<RankedPoint> A;
+	A.reserve(n);
+	for(size_t i = 0; i < n; i++)
+		A.push_back({P[i], i});
+	vector<RankedPoint> S = A;
+
+	TopKHeap heap;
+	topKSearch(A.data(), S.data(), 0, n, k, seed, heap);
+
+	while( !heap.empty() )
+	{
+		result.push_back(heap.top());
+		heap.pop();
+	}
+	reverse(result.begin(), result.end());
+	return result;
+}
+
+
+//! Every kd-tree index file starts with these four bytes
+const char KD_INDEX_MAGIC[4] = {'C', 'P', 'K', 'D'};
+
+//! Version of the kd-tree index layout
+const uint32_t KD_INDEX_VERSION = 2;
+
+//! The header at the start of a kd-tree index file
+struct KdIndexHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t count;
+	uint32_t leafSize;
+	uint32_t pointBytes;
+};
+
+/**
+ *	A static 2D kd-tree laid out flat in one array.
+ *	
+ *	There are no node objects or pointers.  The points are reordered so that every range [lo, hi)
+ *	of the array is a subtree: its median (lo+hi)/2 is the splitting point, the left subtree is
+ *	[lo, mid) and the right one (mid, hi).  The split dimension of each median is kept in a byte
+ *	array next to it, and ranges of KD_LEAF points or fewer are scanned straight through.  The
+ *	original index of every point is kept so results can refer to the caller's points.  Since the
+ *	whole tree is three flat arrays, save and load write and read them as they are.
+ */
+class KdTree
+{
+public:
+	//! Ranges this small are leaves and are scanned instead of split
+	static const int KD_LEAF = 8;
+
+	KdTree() = default;
+
+	/**
+	 *	@brief	Build the tree over n points.
+	 *	
+	 *	@param points	Points to index, copied into the tree
+	 *	@param n		Number of points
+	 */
+	KdTree(const Point* points, size_t n) : ids(n), dims(n, 0)
+	{
+		for(size_t i = 0; i < n; i++)
+			ids[i] = i;
+		build(points, 0, n);
+
+		pts.reserve(n);
+		for(size_t i = 0; i < n; i++)
+			pts.push_back(points[ids[i]]);
+	}
+
+	/**
+	 *	@brief	Find the point nearest to q.
+	 *	
+	 *	@param q		Query point
+	 *	@param dist		Squared distance to the nearest point, LLONG_MAX if there is none
+	 *	@param exclude	Original index of a point to skip, so a point does not find itself
+	 *	@param bound	Only points closer than this are looked for
+	 *	@param found	If given, will hold the nearest point
+	 *	
+	 *	@return Original index of the nearest point, -1 if none is closer than bound.
+	 */
+	long long nearest(const Point& q, long long& dist, long long exclude = -1, long long bound = LLONG_MAX, Point* found = nullptr) const
+	{
+		dist = bound;
+		long long best = -1;
+		long long calcs = 0;
+		search(0, pts.size(), q, exclude, dist, best, calcs);
+		STAT_ADD(distanceCalcs, calcs);
+
+		if( best < 0 )
+			return -1;
+		if( found )
+			*found = pts[best];
+		return ids[best];
+	}
+
+	/**
+	 *	@brief	Find the closest pair that has q as one of its points.
+	 *	
+	 *	If q is one of the indexed points, its partner is the nearest other point.  Otherwise it is
+	 *	simply the nearest point.
+	 *	
+	 *	@param q		Query point
+	 *	@param dist		Squared distance of the pair
+	 *	@param found	If given, will hold the other point of the pair
+	 *	
+	 *	@return Original index of the other point, -1 if there is none.
+	 */
+	long long closestInvolving(const Point& q, long long& dist, Point* found = nullptr) const
+	{
+		// Anything closer than 1 is a copy of q itself
+		long long zero;
+		long long self = nearest(q, zero, -1, 1);
+		return nearest(q, dist, self, LLONG_MAX, found);
+	}
+
+	/**
+	 *	@brief	Answer a batch of queries across the thread pool.
+	 *	
+	 *	@param queries		Query points
+	 *	@param m			Number of queries
+	 *	@param involving	Answer closestInvolving instead of nearest
+	 *	@param threads		Number of threads to answer with
+	 *	@param found		Will hold the original index of every answer, -1 if there is none
+	 *	@param partners		Will hold the point of every answer
+	 *	@param dist			Will hold the squared distance of every answer
+	 *	
+	 *	@return Void.
+	 */
+	void nearestBatch(const Point* queries, size_t m, bool involving, int threads, vector<long long>& found, vector<Point>& partners, vector<long long>& dist) const
+	{
+		found.assign(m, -1);
+		partners.assign(m, Point(0, 0));
+		dist.assign(m, LLONG_MAX);
+
+		TaskPool pool(threads);
+		parallelChunks(pool, 0, m, [&](int, size_t from, size_t to)
+		{
+			for(size_t i = from; i < to; i++)
+			{
+				if( involving )
+					found[i] = closestInvolving(queries[i], dist[i], &partners[i]);
+				else
+					found[i] = nearest(queries[i], dist[i], -1, LLONG_MAX, &partners[i]);
+			}
+		});
+	}
+
+	/**
+	 *	@brief	Write the tree to a file, so it can be loaded instead of rebuilt.
+	 *	
+	 *	The file is a KdIndexHeader followed by the points in tree order, their original indices as
+	 *	64 bit ints and the split dimensions, in the byte order of this machine.
+	 *	
+	 *	@param path		File to write
+	 *	
+	 *	@return True if the file was written.
+	 */
+	bool save(const string& path) const
+	{
+		KdIndexHeader header;
+		memcpy(header.magic, KD_INDEX_MAGIC, 4);
+		header.version = KD_INDEX_VERSION;
+		header.count = pts.size();
+		header.leafSize = KD_LEAF;
+		header.pointBytes = sizeof(Point);
+
+		ofstream out(path, ios::binary);
+		out.write((const char*)&header, sizeof(header));
+		out.write((const char*)pts.data(), pts.size() * sizeof(Point));
+		out.write((const char*)ids.data(), ids.size() * sizeof(uint64_t));
+		out.write((const char*)dims.data(), dims.size());
+		return bool(out);
+	}
+
+	/**
+	 *	@brief	Replace the tree with one written by save.
+	 *	
+	 *	@param path		File to read
+	 *	@param error	Will hold the reason when the file can not be used
+	 *	
+	 *	@return True if the tree was loaded.
+	 */
+	bool load(const string& path, string& error)
+	{
+		ifstream in(path, ios::binary | ios::ate);
+		if( !in )
+		{
+			error = "could not open " + path;
+			return false;
+		}
+		unsigned long long fileSize = in.tellg();
+		in.seekg(0);
+
+		KdIndexHeader header;
+		if( fileSize < sizeof(header) || !in.read((char*)&header, sizeof(header))
+			|| memcmp(header.magic, KD_INDEX_MAGIC, 4) != 0 || header.version != KD_INDEX_VERSION )
+		{
+			error = path + " is not a kd-tree index";
+			return false;
+		}
+		if( header.leafSize != KD_LEAF || header.pointBytes != sizeof(Point) || header.count > fileSize
+			|| fileSize != sizeof(header) + header.count * (sizeof(Point) + sizeof(uint64_t) + 1) )
+		{
+			error = path + " was written with a different layout or is truncated";
+			return false;
+		}
+
+		size_t n = header.count;
+		vector<Point> loadedPts(n, Point(0, 0));
+		vector<uint64_t> loadedIds(n);
+		vector<unsigned char> loadedDims(n);
+		in.read((char*)loadedPts.data(), n * sizeof(Point));
+		in.read((char*)loadedIds.data(), n * sizeof(uint64_t));
+		in.read((char*)loadedDims.data(), n);
+		if( !in )
+		{
+			error = "could not read " + path;
+			return false;
+		}
+		for(size_t i = 0; i < n; i++)
+		{
+			if( loadedIds[i] >= n || loadedDims[i] > 1 )
+			{
+				error = path + " is corrupt";
+				return false;
+			}
+		}
+
+		pts.swap(loadedPts);
+		ids.swap(loadedIds);
+		dims.swap(loadedDims);
+		return true;
+	}
+
+	//! Number of points in the tree
+	size_t size() const
+	{
+		return pts.size();
+	}
+
+private:
+	// Split on the wider side of the range's bounding box, put the median in the middle
+	void build(const Point* points, size_t lo, size_t hi)
+	{
+		if( hi - lo <= KD_LEAF )
+			return;
+
+		int minX = INT_MAX, maxX = INT_MIN, minY = INT_MAX, maxY = INT_MIN;
+		for(size_t i = lo; i < hi; i++)
+		{
+			const Point& p = points[ids[i]];
+			minX = min(minX, p.x);
+			maxX = max(maxX, p.x);
+			minY = min(minY, p.y);
+			maxY = max(maxY, p.y);
+		}
+		unsigned char dim = (long long)maxX - minX >= (long long)maxY - minY ? 0 : 1;
+
+		// Only the ids move while building, the points are gathered in tree order at the end
+		size_t mid = lo + (hi - lo)/2;
+		nth_element(ids.begin() + lo, ids.begin() + mid, ids.begin() + hi, [&](uint64_t a, uint64_t b)
+		{
+			return dim == 0 ? points[a].x < points[b].x : points[a].y < points[b].y;
+		});
+
+		dims[mid] = dim;
+		build(points, lo, mid);
+		build(points, mid + 1, hi);
+	}
+
+	void search(size_t lo, size_t hi, const Point& q, long long exclude, long long& dist, long long& best, long long& calcs) const
+	{
+		if( hi - lo <= KD_LEAF )
+		{
+			for(size_t i = lo; i < hi; i++)
+			{
+				if( (long long)ids[i] == exclude )
+					continue;
+
+				calcs++;
+				long long d = distSquared(q, pts[i]);
+				if( d < dist )
+				{
+					dist = d;
+					best = (long long)i;
+				}
+			}
+			return;
+		}
+
+		size_t mid = lo + (hi - lo)/2;
+		const Point& split = pts[mid];
+		if( (long long)ids[mid] != exclude )
+		{
+			calcs++;
+			long long d = distSquared(q, split);
+			if( d < dist )
+			{
+				dist = d;
+				best = (long long)mid;
+			}
+		}
+
+		// Go down the side q is on first, the other side only if it can still hold something closer
+		long long diff = dims[mid] == 0 ? (long long)q.x - split.x : (long long)q.y - split.y;
+		if( diff < 0 )
+		{
+			search(lo, mid, q, exclude, dist, best, calcs);
+			if( diff * diff < dist )
+				search(mid + 1, hi, q, exclude, dist, best, calcs);
+		}
+		else
+		{
+			search(mid + 1, hi, q, exclude, dist, best, calcs);
+			if( diff * diff < dist )
+				search(lo, mid, q, exclude, dist, best, calcs);
+		}
+	}
+
+	vector<Point> pts;
+	vector<uint64_t> ids;
+	vector<unsigned char> dims;
+};
+
+
+/**
+ *	@brief	Find the nearest neighbour of every point.
+ *	
+ *	One kd-tree is built over all of the points and every point asks it for its nearest other point,
+ *	which is O(n log n) expected instead of the O(n^2) of checking every pair.  The queries are split
+ *	across the thread pool.
+ *	
+ *	@param points	Points to search
+ *	@param n		Number of points, at least 2
+ *	@param threads	Number of threads to query with
+ *	@param nearest	Will hold the index of the nearest neighbour of every point
+ *	@param dist		Will hold the squared distance to that neighbour
+ *	
+ *	@return Void.
+ */
+void allNearestNeighbours(const Point* points, size_t n, int threads, vector<long long>& nearest, vector<long long>& dist)
+{
+	KdTree tree(points, n);
+	nearest.assign(n, -1);
+	dist.assign(n, LLONG_MAX);
+
+	TaskPool pool(threads);
+	parallelChunks(pool, 0, n, [&](int, size_t from, size_t to)
+	{
+		for(size_t i = from; i < to; i++)
+			nearest[i] = tree.nearest(points[i], dist[i], (long long)i);
+	});
+}
+
+
+/**
+ *	@brief	Find the closest pair with one point from each of two sets.
+ *	
+ *	A kd-tree is built over the smaller set and every point of the larger set asks it for its
+ *	nearest point, split across the thread pool.  The best distance found so far is shared between
+ *	the threads and bounds every query, so once a close pair is known most queries stop near the
+ *	root.  O((|A| + |B|) log min(|A|, |B|)) expected, against O(|A| |B|) for checking every pair.
+ *	Equal distances go to the lowest query index and then the point the tree finds first, so the
+ *	answer does not depend on how the threads ran.
+ *	
+ *	@param red			First set
+ *	@param redCount		Number of points in the first set
+ *	@param blue			Second set
+ *	@param blueCount	Number of points in the second set
+ *	@param closestPair	Will hold the red point first and the blue point second, untouched if a set is empty
+ *	@param threads		Number of threads to query with
+ *	
+ *	@return The squared distance between the two points, LLONG_MAX if either set is empty.
+ */
+long long bichromaticClosestPair(const Point* red, size_t redCount, const Point* blue, size_t blueCount, pair<Point, Point>& closestPair, int threads)
+{
+	if( redCount == 0 || blueCount == 0 )
+		return LLONG_MAX;
+
+	bool treeIsRed = redCount <= blueCount;
+	const Point* indexed = treeIsRed ? red : blue;
+	const Point* queries = treeIsRed ? blue : red;
+	size_t queryCount = treeIsRed ? blueCount : redCount;
+
+	KdTree tree(indexed, treeIsRed ? redCount : blueCount);
+
+	atomic<long long> shared{LLONG_MAX};
+	mutex bestLock;
+	long long best = LLONG_MAX;
+	long long bestQuery = -1, bestIndexed = -1;
+
+	TaskPool pool(threads);
+	parallelChunks(pool, 0, queryCount, [&](int, size_t from, size_t to)
+	{
+		long long local = LLONG_MAX;
+		long long localQuery = -1, localIndexed = -1;
+		for(size_t i = from; i < to && local > 0; i++)
+		{
+			// A tie with the shared best can still win on a lower query index, so it is not pruned
+			long long seen = shared.load(memory_order_relaxed);
+			long long bound = min(local, seen == LLONG_MAX ? seen : seen + 1);
+			long long dist;
+			long long j = tree.nearest(queries[i], dist, -1, bound);
+			if( j < 0 )
+				continue;
+
+			local = dist;
+			localQuery = i;
+			localIndexed = j;
+
+			seen = shared.load(memory_order_relaxed);
+			while( dist < seen && !shared.compare_exchange_weak(seen, dist, memory_order_relaxed) )
+				;
+		}
+
+		lock_guard<mutex> guard(bestLock);
+		if( localQuery >= 0 && (local < best || (local == best && localQuery < bestQuery)) )
+		{
+			best = local;
+			bestQuery = localQuery;
+			bestIndexed = localIndexed;
+		}
+	});
+
+	const Point& q = queries[bestQuery];
+	const Point& t = indexed[bestIndexed];
+	closestPair = treeIsRed ? make_pair(t, q) : make_pair(q, t);
+	return best;
+}
+
+
+/**
+ *	Keeps the closest pair of a growing set of points up to date as points are inserted.
+ *	
+ *	The points live in a hashed grid with cells at least as wide as the current closest distance d,
+ *	so a new point only has to be checked against the 9 cells around it.  When d shrinks to half the
+ *	cell width or less the grid is rebuilt with narrower cells.  The cell width is a whole number
+ *	that at least halves on every rebuild, so there are at most 32 rebuilds over the life of the
+ *	structure and an insert costs O(1) amortized.  Cells hold at most a constant number of points
+ *	because no two points in the set are closer than d.
+ */
+class IncrementalClosestPair
+{
+public:
+	/**
+	 *	@brief	Insert one point and update the closest pair.
+	 *	
+	 *	@param p	Point to add
+	 *	
+	 *	@return True if the closest pair changed.
+	 */
+	bool insert(const Point& p)
+	{
+		size_t id = stored.size();
+		stored.push_back(p);
+
+		if( id == 0 || best == 0 )
+			return false;
+
+		if( cell == 0 )
+		{
+			best = distSquared(stored[0], p);
+			closestPair = {stored[0], p};
+			if( best > 0 )
+				rebuild(cellWidth(best));
+			return true;
+		}
+
+		// Only the cells around p can hold a point closer than best
+		long long cx = floorDiv(p.x, cell);
+		long long cy = floorDiv(p.y, cell);
+		bool changed = false;
+		for(long long nx = cx - 1; nx <= cx + 1; nx++)
+		{
+			for(long long ny = cy - 1; ny <= cy + 1; ny++)
+			{
+				auto found = grid.find(cellKey(nx, ny));
+				if( found == grid.end() )
+					continue;
+
+				for(size_t j : found->second)
+				{
+					long long dist = distSquared(stored[j], p);
+					if( dist < best )
+					{
+						best = dist;
+						closestPair = {stored[j], p};
+						changed = true;
+					}
+				}
+			}
+		}
+
+		if( best == 0 )
+		{
+			// Nothing can beat a repeated point, the grid is not needed anymore
+			grid.clear();
+		}
+		else if( cellWidth(best) * 2 <= cell )
+		{
+			rebuild(cellWidth(best));
+		}
+		else
+		{
+			grid[cellKey(cx, cy)].push_back(id);
+		}
+
+		return changed;
+	}
+
+	/**
+	 *	@brief	Insert a batch of points.
+	 *	
+	 *	@param batch	Points to add
+	 *	@param n		Number of points
+	 *	
+	 *	@return True if the closest pair changed.
+	 */
+	bool insert(const Point* batch, size_t n)
+	{
+		stored.reserve(stored.size() + n);
+
+		bool changed = false;
+		for(size_t i = 0; i < n; i++)
+			changed |= insert(batch[i]);
+		return changed;
+	}
+
+	//! Number of points inserted so far
+	size_t size() const
+	{
+		return stored.size();
+	}
+
+	//! Squared distance of the closest pair, LLONG_MAX until there are two points
+	long long distance() const
+	{
+		return best;
+	}
+
+	//! The current closest pair, only valid once there are two points
+	const pair<Point, Point>& closest() const
+	{
+		return closestPair;
+	}
+
+	//! Number of times the grid has been rebuilt
+	int rebuilds() const
+	{
+		return rebuildCount;
+	}
+
+private:
+	static unsigned long long cellKey(long long cx, long long cy)
+	{
+		return ((unsigned long long)(uint32_t)cx << 32) | (uint32_t)cy;
+	}
+
+	// Put every point back into a grid with the new cell width
+	void rebuild(long long width)
+	{
+		cell = width;
+		grid.clear();
+		grid.reserve(stored.size());
+		for(size_t i = 0; i < stored.size(); i++)
+			grid[cellKey(floorDiv(stored[i].x, cell), floorDiv(stored[i].y, cell))].push_back(i);
+		rebuildCount++;
+	}
+
+	vector<Point> stored;
+	unordered_map<unsigned long long, vector<size_t>> grid;
+	long long cell = 0;
+	long long best = LLONG_MAX;
+	pair<Point, Point> closestPair{Point(0, 0), Point(0, 0)};
+	int rebuildCount = 0;
+};
+
+
+/**
+ *	Keeps the closest pair among the last W points of a stream, or the points newer than some time.
+ *	
+ *	Points expire in the order they arrived, so every grid cell is a FIFO of point ids, linked through
+ *	the points, and an expired point is always at the front of its cell.  Each new point looks at the 9 cells around it and
+ *	pushes candidate pairs onto a min heap.  Only neighbours that are closer than every newer
+ *	neighbour are pushed: any other one would expire before a closer pair that is already in the
+ *	heap.  Pairs with an expired point are dropped lazily when they reach the top of the heap, and
+ *	the whole heap is compacted when it grows past twice its size after the last compaction.
+ *	
+ *	Every pair closer than the cell width is in the heap, so the top is the answer as long as it is
+ *	within one cell width.  When it is not (the closest points expired and the answer grew) the grid
+ *	and heap are rebuilt around the real closest distance of the window, found with gridClosestPoint.
+ *	The cells are then CELL_SPREAD times that distance, so the answer can grow 4x first.  When the
+ *	answer halves the cells are only slower, so that rebuild waits until a window of inserts and
+ *	expiries has paid for its O(W), unless the answer shrank 8x and the cells could fill up.
+ */
+class SlidingWindowClosestPair
+{
+public:
+	/**
+	 *	@param window	Number of points to keep, 0 keeps everything until expireBefore drops it
+	 */
+	explicit SlidingWindowClosestPair(size_t window) : window{window}
+	{}
+
+	/**
+	 *	@brief	Add the newest point, expiring the oldest one if the window is full.
+	 *	
+	 *	@param p	Point to add
+	 *	@param time	Time stamp of the point, only used by expireBefore
+	 *	
+	 *	@return Void.
+	 */
+	void insert(const Point& p, long long time = 0)
+	{
+		if( window > 0 && alive.size() == window )
+			expireOldest();
+
+		alive.push_back({p, time, -1});
+		long long id = firstId + alive.size() - 1;
+
+		if( cell == 0 )
+		{
+			// Not enough points yet to size the grid
+			if( alive.size() >= 2 )
+				rebuild();
+			return;
+		}
+
+		place(id);
+		changes++;
+		refresh();
+	}
+
+	/**
+	 *	@brief	Expire every point with a time stamp older than time.
+	 *	
+	 *	@param time	Oldest time stamp to keep
+	 *	
+	 *	@return Void.
+	 */
+	void expireBefore(long long time)
+	{
+		bool expired = false;
+		while( !alive.empty() && alive.front().time < time )
+		{
+			expireOldest();
+			expired = true;
+		}
+
+		if( expired )
+			refresh();
+	}
+
+	//! Number of points in the window
+	size_t size() const
+	{
+		return alive.size();
+	}
+
+	//! Squared distance of the closest pair in the window, LLONG_MAX with fewer than two points
+	long long distance() const
+	{
+		return heap.empty() ? LLONG_MAX : heap.front().dist;
+	}
+
+	//! The closest pair in the window, only valid when there are two points
+	pair<Point, Point> closest() const
+	{
+		const Candidate& top = heap.front();
+		return {pointAt(top.older), pointAt(top.newer)};
+	}
+
+	//! Number of times the grid has been rebuilt
+	int rebuilds() const
+	{
+		return rebuildCount;
+	}
+
+private:
+	struct Entry
+	{
+		Point p;
+		long long time;
+		long long next;		//!< Id of the next newer point in the same cell, -1 if there is none
+	};
+
+	//! Ids of the oldest and newest point in a cell
+	struct Cell
+	{
+		long long oldest;
+		long long newest;
+	};
+
+	struct Candidate
+	{
+		long long dist;
+		long long older;
+		long long newer;
+
+		bool operator>(const Candidate& other) const
+		{
+			return dist > other.dist;
+		}
+	};
+
+	static unsigned long long cellKey(long long cx, long long cy)
+	{
+		return ((unsigned long long)(uint32_t)cx << 32) | (uint32_t)cy;
+	}
+
+	const Point& pointAt(long long id) const
+	{
+		return alive[id - firstId].p;
+	}
+
+	unsigned long long keyOf(const Point& p) const
+	{
+		return cellKey(floorDiv(p.x, cell), floorDiv(p.y, cell));
+	}
+
+	// Drop the oldest point from the window and from the front of its cell
+	void expireOldest()
+	{
+		if( cell != 0 )
+		{
+			auto found = grid.find(keyOf(alive.front().p));
+			if( found->second.newest == firstId )
+				grid.erase(found);
+			else
+				found->second.oldest = alive.front().next;
+		}
+
+		alive.pop_front();
+		firstId++;
+		changes++;
+
+		if( alive.size() < 2 )
+		{
+			cell = 0;
+			grid.clear();
+			heap.clear();
+		}
+	}
+
+	// Push the useful pairs between the point and the older points around it, then add it to the grid
+	void place(long long id)
+	{
+		const Point& p = pointAt(id);
+		long long cx = floorDiv(p.x, cell);
+		long long cy = floorDiv(p.y, cell);
+
+		neighbours.clear();
+		for(long long nx = cx - 1; nx <= cx + 1; nx++)
+		{
+			for(long long ny = cy - 1; ny <= cy + 1; ny++)
+			{
+				auto found = grid.find(cellKey(nx, ny));
+				if( found == grid.end() )
+					continue;
+
+				for(long long other = found->second.oldest; other >= 0; other = alive[other - firstId].next)
+					neighbours.push_back({distSquared(pointAt(other), p), other, id});
+			}
+		}
+
+		// Newest neighbours first, keep only the ones closer than every newer one
+		sort(neighbours.begin(), neighbours.end(), [](const Candidate& a, const Candidate& b){ return a.older > b.older; });
+		long long nearest = LLONG_MAX;
+		for(const Candidate& c : neighbours)
+		{
+			if( c.dist < nearest )
+			{
+				nearest = c.dist;
+				heap.push_back(c);
+				push_heap(heap.begin(), heap.end(), greater<Candidate>());
+			}
+		}
+
+		auto placed = grid.emplace(cellKey(cx, cy), Cell{id, id});
+		if( !placed.second )
+		{
+			alive[placed.first->second.newest - firstId].next = id;
+			placed.first->second.newest = id;
+		}
+	}
+
+	// Drop the expired candidates at the top of the heap
+	void popExpired()
+	{
+		while( !heap.empty() && heap.front().older < firstId )
+		{
+			pop_heap(heap.begin(), heap.end(), greater<Candidate>());
+			heap.pop_back();
+		}
+	}
+
+	// Drop the expired candidates below the top too, so the heap stays O(window)
+	void compact()
+	{
+		heap.erase(remove_if(heap.begin(), heap.end(), [this](const Candidate& c){ return c.older < firstId; }), heap.end());
+		make_heap(heap.begin(), heap.end(), greater<Candidate>());
+		compactAt = 2 * max(heap.size(), alive.size());
+	}
+
+	// Drop expired candidates and rebuild when the top can no longer be trusted
+	void refresh()
+	{
+		if( cell == 0 )
+			return;
+
+		popExpired();
+		if( heap.size() > compactAt )
+			compact();
+
+		// Past one cell width the top may not be the answer, so that rebuild can't wait.  Cells that
+		// are too wide only cost time, so that one waits for a window of changes to pay for it,
+		// unless the answer shrank so far that the cells could fill up.
+		if( heap.empty() || heap.front().dist > reach )
+			rebuild();
+		else if( heap.front().dist < shrunk && (heap.front().dist < crowded || changes >= alive.size()) )
+			rebuild();
+	}
+
+	// Size the cells from the real closest distance of the window and place every point again
+	void rebuild()
+	{
+		vector<Point> window;
+		window.reserve(alive.size());
+		for(const Entry& e : alive)
+			window.push_back(e.p);
+
+		pair<Point, Point> unused{window[0], window[1]};
+		long long best = gridClosestPoint(window, unused, rebuildCount);
+
+		// Wider than needed so the answer can grow before the next rebuild
+		cell = CELL_SPREAD * cellWidth(max(1ll, best));
+		unsigned __int128 square = (unsigned __int128)cell * cell;
+		reach = square > LLONG_MAX ? LLONG_MAX : (long long)square;
+		shrunk = reach / (CELL_SPREAD * CELL_SPREAD * 4);
+		crowded = reach / (CELL_SPREAD * CELL_SPREAD * 64);
+
+		grid.clear();
+		grid.reserve(alive.size());
+		heap.clear();
+		for(Entry& e : alive)
+			e.next = -1;
+		for(long long id = firstId; id < firstId + (long long)alive.size(); id++)
+			place(id);
+
+		popExpired();
+		compactAt = 2 * max(heap.size(), alive.size());
+		changes = 0;
+		rebuildCount++;
+	}
+
+	//! Cells are this many times the closest distance of the window after a rebuild
+	static const long long CELL_SPREAD = 4;
+
+	size_t window;
+	deque<Entry> alive;
+	long long firstId = 0;
+	long long cell = 0;
+	long long reach = 0;	//!< Squared cell width, saturated at LLONG_MAX
+	long long shrunk = 0;	//!< Answers below this have half the distance of the last rebuild
+	long long crowded = 0;	//!< Answers below this have an eighth of it
+	size_t changes = 0;		//!< Inserts and expiries since the last rebuild
+	size_t compactAt = 0;
+	unordered_map<unsigned long long, Cell> grid;
+	vector<Candidate> heap;	//!< Min heap on the distance
+	vector<Candidate> neighbours;
+	int rebuildCount = 0;
+};
+
+
+/**
+ *	@brief	Time the sliding window structure against recomputing every window from scratch.
+ *	
+ *	For every window size W a random stream is pushed through a SlidingWindowClosestPair and the
+ *	average time per new point is measured over at least W new points.  The same windows are
+ *	recomputed with the in place divide and conquer, which is the cheapest full recompute here (a
+ *	brute force recompute is O(W^2) and can not finish at 10^6), on fewer steps, and both answers
+ *	are checked against each other.
+ *	
+ *	@param seed		Seed for the random stream
+ *	
+ *	@return Zero if the answers always matched.
+ */
+int runWindowBenchmark(unsigned long long seed)
+{
+	typedef chrono::steady_clock Clock;
+	mt19937_64 rng(seed);
+	bool matched = true;
+
+	cout << "W\twindow us/pt\trecompute us/pt\tspeedup\trebuilds" << endl;
+	for(int w = 1000; w <= 1000000; w *= 10)
+	{
+		// At least a whole window, so the rebuilds the window pays for fall inside the timing
+		int steps = max(20000, w);
+		int checks = max(5, min(200, 20000000 / w));
+		vector<Point> stream;
+		for(int i = 0; i < w + steps; i++)
+			stream.emplace_back(int(rng() % (1u << 30)), int(rng() % (1u << 30)));
+
+		SlidingWindowClosestPair slider(w);
+		for(int i = 0; i < w; i++)
+			slider.insert(stream[i]);
+
+		// Time the window structure, remembering the answers of the steps that get checked
+		vector<long long> answers(checks);
+		int every = steps / checks;
+		Clock::time_point start = Clock::now();
+		for(int i = 0; i < steps; i++)
+		{
+			slider.insert(stream[w + i]);
+			if( i % every == 0 && i / every < checks )
+				answers[i / every] = slider.distance();
+		}
+		double windowUs = chrono::duration<double, micro>(Clock::now() - start).count() / steps;
+
+		// Time the recompute on the checked steps only
+		double recomputeUs = 0;
+		for(int c = 0; c < checks; c++)
+		{
+			int end = w + c * every + 1;
+			vector<Point> current(stream.begin() + end - w, stream.begin() + end);
+
+			start = Clock::now();
+			pair<Point, Point> closest{current[0], current[1]};
+			long long ds = divideClosestPoint(current, closest, true);
+			recomputeUs += chrono::duration<double, micro>(Clock::now() - start).count();
+
+			if( ds != answers[c] )
+				matched = false;
+		}
+		recomputeUs /= checks;
+
+		cout << w << "\t" << windowUs << "\t" << recomputeUs << "\t" << recomputeUs / windowUs
+			<< "\t" << slider.rebuilds() << endl;
+	}
+
+	if( !matched )
+		cout << "Error: the window and the recompute disagreed" << endl;
+	return matched ? 0 : 1;
+}
+
+
+/**
+ *	@brief	Read "x y" pairs from std input until it ends and report the closest pair every time it
+ *			changes, using IncrementalClosestPair.
+ *	
+ *	@return Zero, one if a coordinate is outside MAX_COORD.
+ */
+int runStream()
+{
+	IncrementalClosestPair stream;
+	int x, y;
+
+	while( cin >> x >> y )
+	{
+		if( !inCoordRange(x) || !inCoordRange(y) )
+		{
+			cout << "Error: (" << x << ", " << y << ") is outside +-" << MAX_COORD << endl;
+			return 1;
+		}
+
+		if( stream.insert(Point(x, y)) )
+		{
+			const pair<Point, Point>& c = stream.closest();
+			cout << "N: " << stream.size() << "  Point 1: (" << c.first.x << ", " << c.first.y << ")"
+				<< "  Point 2: (" << c.second.x << ", " << c.second.y << ")"
+				<< "  Distance squared: " << stream.distance() << "\n";
+		}
+	}
+
+	cout << "Points: " << stream.size() << "\n";
+	cout << "Grid rebuilds: " << stream.rebuilds() << endl;
+	return 0;
+}
+
+
+/**
+ *	@brief		Compare two strings for equality, ignoring case.
+ *	
+ *	@param a	String to use for comparison
+ *	@param b	String to compare A to
+ *	
+ *	@return True is the strings are the same ignoring case, False otherwise
+ */
+bool equalIC(const string& a, const string& b)
+{
+	// if they are identical, the language can handle that
+	if( a == b ) return true;
+
+	bool areEqual = true;
+
+	// must be same length
+	if( a.length() != b.length() )
+		areEqual = false;
+
+	// compare each char
+	for( size_t i = 0; i < a.length() && areEqual; i++)
+	{
+		// if they are not the same, we are done
+		if( toupper(a[i]) != toupper(b[i]))
+			areEqual = false;
+	}
+
+	return areEqual;
+}
+
+
+/**
+ *	@brief		Read in a coordinate from std input.
+ *	
+ *	@param limit	Largest magnitude the engines can take exactly
+ *	
+ *	@return		The integer read from input, within +-limit.
+ */
+int getNextInt(int limit = MAX_COORD)
+{
+	bool valid = false;
+	int input;
+
+	// Continue trying to get a valid int.
+	while( !valid )
+	{
+		while( !( cin >> input ) )
+		{
+			cout << "Bad input" << endl;
+			cin.clear();
+			string bad;
+			getline(cin, bad);
+		}
+
+		if( input < -limit || input > limit )
+			cout << "Must be within +-" << limit << "." << endl;
+		else
+			valid = true;
+	}
+
+	return input;
+}
+
+
+/**
+ *	@brief		Read in a positive number from std input.
+ *	
+ *	@return		A positive number entered by the user through std input.
+ */
+unsigned long long getNextPos()
+{
+	bool valid = false;
+	long long input;
+
+	// Contiue trying to get a valid pos int
+	while( !valid )
+	{
+		while( !( cin >> input ) )
+		{
+			cout << "Bad input" << endl;
+			cin.clear();
+			string bad;
+			getline(cin, bad);
+		}
+
+		if(input < 0)
+			cout << "Must be positive." << endl;
+		else
+			valid = true;
+	}
+
+	return input;
+}
+
+
+/**
+ *	A whole file mapped into memory.  Where mmap is not available the file is read into a buffer
+ *	instead, so callers only ever see data() and size().
+ */
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile()
+	{
+#ifndef CLOSEST_NO_MMAP
+		if( mapped != nullptr )
+			munmap(mapped, length);
+#endif
+	}
+
+	/**
+	 *	@brief	Map the file at path, read only.
+	 *	
+	 *	@param path		File to open
+	 *	
+	 *	@return False if the file could not be opened or mapped.
+	 */
+	bool open(const string& path)
+	{
+#ifndef CLOSEST_NO_MMAP
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if( fd < 0 )
+			return false;
+
+		struct stat info;
+		if( fstat(fd, &info) != 0 )
+		{
+			close(fd);
+			return false;
+		}
+
+		length = info.st_size;
+		if( length > 0 )
+		{
+			void* view = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+			if( view == MAP_FAILED )
+			{
+				close(fd);
+				return false;
+			}
+			mapped = (char*)view;
+			madvise(mapped, length, MADV_SEQUENTIAL);
+		}
+		close(fd);
+		return true;
+#else
+		ifstream in(path, ios::binary);
+		if( !in )
+			return false;
+		buffer.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+		mapped = buffer.data();
+		length = buffer.size();
+		return true;
+#endif
+	}
+
+	const char* data() const
+	{
+		return mapped;
+	}
+
+	size_t size() const
+	{
+		return length;
+	}
+
+private:
+	char* mapped = nullptr;
+	size_t length = 0;
+#ifdef CLOSEST_NO_MMAP
+	vector<char> buffer;
+#endif
+};
+
+
+#ifdef _MSC_VER
+inline int __builtin_ctzll(unsigned long long v)
+{
+	unsigned long index;
+	_BitScanForward64(&index, v);
+	return int(index);
+}
+#endif
+
+//! Whitespace as cin sees it between numbers
+inline bool isBlank(char c)
+{
+	return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/**
+ *	@brief	Parse one signed decimal token starting at p.
+ *	
+ *	The digits are read 8 at a time with SWAR (SIMD within a register): the bytes are loaded into
+ *	one 64 bit word, the run of digits is found with a single compare of all 8 bytes and then
+ *	converted with three multiply and mask steps.  Only the digits past the first 8 and the tail
+ *	of the file are handled one at a time.
+ *	
+ *	@param p		Start of the token, moved past it
+ *	@param end		End of the buffer
+ *	@param value	The parsed value
+ *	
+ *	@return False if the token is not a number that fits in an int.
+ */
+bool parseIntToken(const char*& p, const char* end, int& value)
+{
+	bool negative = false;
+	if( p < end && (*p == '-' || *p == '+') )
+	{
+		negative = *p == '-';
+		p++;
+	}
+
+	long long result = 0;
+	const char* digits = p;
+
+	if( end - p >= 8 )
+	{
+		uint64_t word;
+		memcpy(&word, p, 8);
+
+		// A byte is a digit when it is 0-9 after the xor, the first one that is not ends the run
+		uint64_t x = word ^ 0x3030303030303030ull;
+		uint64_t bad = ((x + 0x7676767676767676ull) | x) & 0x8080808080808080ull;
+		int len = bad ? __builtin_ctzll(bad) / 8 : 8;
+
+		if( len > 0 )
+		{
+			// Push the digits to the top bytes so missing digits act as leading zeros
+			x <<= 8 * (8 - len);
+			x = (x * 10 + (x >> 8)) & 0x00FF00FF00FF00FFull;
+			x = (x * 100 + (x >> 16)) & 0x0000FFFF0000FFFFull;
+			x = (x * 10000 + (x >> 32)) & 0x00000000FFFFFFFFull;
+			result = x;
+			p += len;
+		}
+	}
+
+	while( p < end && *p >= '0' && *p <= '9' )
+	{
+		result = result * 10 + (*p - '0');
+		p++;
+		if( result > 2147483648ll )
+			return false;
+	}
+
+	if( p == digits || (p < end && !isBlank(*p)) )
+		return false;
+
+	if( negative )
+		result = -result;
+	if( result > INT_MAX || result < INT_MIN )
+		return false;
+
+	value = int(result);
+	return true;
+}
+
+/**
+ *	@brief	Parse the point count at the start of an input, which can be past the range of an int.
+ *	
+ *	@param p		Start of the token, moved past it
+ *	@param end		End of the buffer
+ *	@param value	The parsed count
+ *	
+ *	@return False if the token is not a whole number of at most 2^62.
+ */
+bool parseCountToken(const char*& p, const char* end, long long& value)
+{
+	if( p < end && *p == '+' )
+		p++;
+
+	long long result = 0;
+	const char* digits = p;
+	while( p < end && *p >= '0' && *p <= '9' )
+	{
+		result = result * 10 + (*p - '0');
+		p++;
+		if( result > (1ll << 62) )
+			return false;
+	}
+
+	if( p == digits || (p < end && !isBlank(*p)) )
+		return false;
+
+	value = result;
+	return true;
+}
+
+//! What the first pass learned about one chunk of an input file
+struct ChunkInfo
+{
+	long long tokens = 0;
+	long long lines = 0;
+};
+
+/**
+ *	@brief	Load points in the "count then pairs" text format from a file.
+ *	
+ *	The file is memory mapped and everything after the count is split into one chunk per thread,
+ *	each starting just after a newline so no number is cut in half.  A first parallel pass counts
+ *	the numbers and newlines of every chunk, which tells each chunk where its numbers go and which
+ *	line it starts on.  The second parallel pass parses straight into the preallocated points.
+ *	Numbers past the 2*count that are needed are ignored, the same as with std input.
+ *	
+ *	@param path		File to read
+ *	@param out		Will hold the points
+ *	@param threads	Number of threads to parse with
+ *	@param error	Set to a message with the line number when loading fails
+ *	
+ *	@return False if the file could not be read or is malformed.
+ */
+bool loadPointsFile(const string& path, vector<Point>& out, int threads, string& error)
+{
+	MappedFile file;
+	if( !file.open(path) )
+	{
+		error = "could not open " + path;
+		return false;
+	}
+
+	const char* begin = file.data();
+	const char* end = begin + file.size();
+	const char* p = begin;
+	long long line = 1;
+
+	// The count comes first
+	while( p < end && isBlank(*p) )
+	{
+		line += *p == '\n';
+		p++;
+	}
+	long long count;
+	if( p == end || !parseCountToken(p, end, count) )
+	{
+		error = "line " + to_string(line) + ": expected a positive point count";
+		return false;
+	}
+
+	// Split the rest at newlines
+	int chunks = int(max<long long>(1, min<long long>(threads * 4, (end - p) / (1 << 20))));
+	vector<const char*> bounds(chunks + 1);
+	bounds[0] = p;
+	bounds[chunks] = end;
+	for(int c = 1; c < chunks; c++)
+	{
+		const char* cut = max(bounds[c-1], p + (end - p) / chunks * c);
+		const char* nl = (const char*)memchr(cut, '\n', end - cut);
+		bounds[c] = nl ? nl + 1 : end;
+	}
+
+	TaskPool pool(threads);
+	vector<ChunkInfo> info(chunks);
+	TaskGroup group;
+
+	// First pass, count numbers and lines
+	for(int c = 0; c < chunks; c++)
+	{
+		pool.spawn(group, [&, c]
+		{
+			bool inToken = false;
+			for(const char* q = bounds[c]; q < bounds[c+1]; q++)
+			{
+				bool blank = isBlank(*q);
+				info[c].tokens += !blank && !inToken;
+				info[c].lines += *q == '\n';
+				inToken = !blank;
+			}
+		});
+	}
+	pool.wait(group);
+
+	vector<long long> firstToken(chunks + 1, 0), firstLine(chunks + 1, line);
+	for(int c = 0; c < chunks; c++)
+	{
+		firstToken[c+1] = firstToken[c] + info[c].tokens;
+		firstLine[c+1] = firstLine[c] + info[c].lines;
+	}
+
+	long long needed = 2ll * count;
+	if( firstToken[chunks] < needed )
+	{
+		error = "line " + to_string(firstLine[chunks]) + ": expected " + to_string(count) + " points, found "
+			+ to_string(firstToken[chunks] / 2);
+		return false;
+	}
+
+	// Second pass, parse straight into the points
+	out.assign(count, Point(0, 0));
+	vector<long long> badLine(chunks, -1);
+	vector<char> badRange(chunks, 0);
+	for(int c = 0; c < chunks; c++)
+	{
+		if( firstToken[c] >= needed )
+			break;
+
+		pool.spawn(group, [&, c]
+		{
+			const char* q = bounds[c];
+			const char* stop = bounds[c+1];
+			long long token = firstToken[c];
+			long long at = firstLine[c];
+
+			while( token < needed )
+			{
+				while( q < stop && isBlank(*q) )
+				{
+					at += *q == '\n';
+					q++;
+				}
+				if( q == stop )
+					break;
+
+				int value;
+				if( !parseIntToken(q, stop, value) )
+				{
+					badLine[c] = at;
+					return;
+				}
+				if( !inCoordRange(value) )
+				{
+					badLine[c] = at;
+					badRange[c] = 1;
+					return;
+				}
+
+				if( token % 2 == 0 )
+					out[token / 2].x = value;
+				else
+					out[token / 2].y = value;
+				token++;
+			}
+		});
+	}
+	pool.wait(group);
+
+	for(int c = 0; c < chunks; c++)
+	{
+		if( badLine[c] >= 0 )
+		{
+			if( badRange[c] )
+				error = "line " + to_string(badLine[c]) + ": coordinate outside +-" + to_string(MAX_COORD);
+			else
+				error = "line " + to_string(badLine[c]) + ": expected an integer";
+			out.clear();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+//! Magic bytes at the start of a binary point file
+const char POINT_FILE_MAGIC[4] = {'C', 'P', 'T', 'S'};
+
+//! Current version of the binary point file format
+const uint32_t POINT_FILE_VERSION = 1;
+
+//! Flags stored in a binary point file header
+enum PointFileFlags
+{
+	SORTED_BY_X = 1
+};
+
+/**
+ *	Header of a binary point file.  It is followed by count packed (x, y) pairs of coordBytes
+ *	wide little endian ints, which is exactly the layout of Point, so a mapped file can be
+ *	handed to the engines as a Point array.
+ */
+struct PointFileHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t count;
+	uint32_t coordBytes;
+	uint32_t flags;
+};
+
+static_assert(sizeof(PointFileHeader) == 24, "PointFileHeader must stay packed");
+static_assert(sizeof(Point) == 2 * sizeof(int32_t), "Point must match the binary point layout");
+
+/**
+ *	@brief	Check if a file starts with the binary point file magic.
+ *	
+ *	@param path		File to check
+ *	
+ *	@return True if the file is a binary point file.
+ */
+bool isPointFile(const string& path)
+{
+	char magic[4] = {0};
+	ifstream in(path, ios::binary);
+	in.read(magic, 4);
+	return in && memcmp(magic, POINT_FILE_MAGIC, 4) == 0;
+}
+
+/**
+ *	@brief	Map a binary point file and point at its points without copying them.
+ *	
+ *	@param path		File to map
+ *	@param file		The mapping, the points are only valid while it is open
+ *	@param data		Set to the first point in the mapping
+ *	@param count	Set to the number of points
+ *	@param flags	Set to the PointFileFlags of the file
+ *	@param error	Set to a message when the file can not be used
+ *	
+ *	@return False if the file could not be mapped, has a bad header, a coordinate outside MAX_COORD
+ *			or is not in the order its flags claim.
+ */
+bool openPointFile(const string& path, MappedFile& file, const Point*& data, size_t& count, uint32_t& flags, string& error)
+{
+	if( !file.open(path) )
+	{
+		error = "could not open " + path;
+		return false;
+	}
+
+	PointFileHeader header;
+	if( file.size() < sizeof(header) )
+	{
+		error = path + ": file is too short for a header";
+		return false;
+	}
+	memcpy(&header, file.data(), sizeof(header));
+
+	if( memcmp(header.magic, POINT_FILE_MAGIC, 4) != 0 || header.version != POINT_FILE_VERSION )
+	{
+		error = path + ": not a version " + to_string(POINT_FILE_VERSION) + " point file";
+		return false;
+	}
+	if( header.coordBytes != sizeof(int32_t) )
+	{
+		error = path + ": unsupported coordinate width " + to_string(header.coordBytes);
+		return false;
+	}
+	if( header.count > (file.size() - sizeof(header)) / sizeof(Point) )
+	{
+		error = path + ": point count does not match the file size";
+		return false;
+	}
+
+	data = (const Point*)(file.data() + sizeof(header));
+	count = size_t(header.count);
+	flags = header.flags;
+
+	if( flags & ~uint32_t(SORTED_BY_X) )
+	{
+		error = path + ": unknown flags " + to_string(flags);
+		return false;
+	}
+
+	// The file is not trusted, every coordinate has to fit the engines and the order has to be
+	// what the flags claim, since the engines skip their presort for it
+	for(size_t i = 0; i < count; i++)
+	{
+		if( !inCoordRange(data[i].x) || !inCoordRange(data[i].y) )
+		{
+			error = path + ": point " + to_string(i+1) + " has a coordinate outside +-" + to_string(MAX_COORD);
+			return false;
+		}
+		if( (flags & SORTED_BY_X) && i > 0 && data[i].x < data[i-1].x )
+		{
+			error = path + ": marked as sorted by x, but point " + to_string(i+1) + " is out of order";
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ *	@brief	Write points to a binary point file.
+ *	
+ *	@param path		File to write
+ *	@param points	Points to write
+ *	@param flags	PointFileFlags describing the order of the points
+ *	
+ *	@return False if the file could not be written.
+ */
+bool writePointFile(const string& path, const vector<Point>& points, uint32_t flags)
+{
+	PointFileHeader header;
+	memcpy(header.magic, POINT_FILE_MAGIC, 4);
+	header.version = POINT_FILE_VERSION;
+	header.count = points.size();
+	header.coordBytes = sizeof(int32_t);
+	header.flags = flags;
+
+	ofstream out(path, ios::binary);
+	out.write((const char*)&header, sizeof(header));
+	out.write((const char*)points.data(), points.size() * sizeof(Point));
+	return bool(out);
+}
+
+/**
+ *	@brief	Convert a text point file into a binary one, sorted by x.
+ *	
+ *	The points are written sorted by x so the divide and conquer and the sweep can run straight
+ *	on the mapped file without a copy or a presort.
+ *	
+ *	@param from		Text file in the count then pairs format
+ *	@param to		Binary file to write
+ *	@param threads	Threads to parse the text with
+ *	
+ *	@return Zero on success.
+ */
+int convertPointFile(const string& from, const string& to, int threads)
+{
+	vector<Point> converted;
+	string error;
+	if( !loadPointsFile(from, converted, threads, error) )
+	{
+		cout << "Error: " << error << endl;
+		return 1;
+	}
+
+	sortByX(converted);
+	if( !writePointFile(to, converted, SORTED_BY_X) )
+	{
+		cout << "Error: could not write " << to << endl;
+		return 1;
+	}
+
+	cout << "Wrote " << converted.size() << " points to " << to << endl;
+	return 0;
+}
+
+
+/**
+ *	@brief	Open a point file of either format.
+ *	
+ *	Binary point files are mapped and used in place, text files are parsed into storage.
+ *	
+ *	@param path		File to open
+ *	@param storage	Holds the points of a text file
+ *	@param file		Holds the mapping of a binary file
+ *	@param data		Will point at the points
+ *	@param count	Will hold the number of points
+ *	@param flags	Will hold the PointFileFlags of a binary file, zero for text
+ *	@param threads	Threads to parse text with
+ *	@param error	Will hold the reason when the file can not be used
+ *	
+ *	@return True if the points were read.
+ */
+bool openPoints(const string& path, vector<Point>& storage, MappedFile& file, const Point*& data, size_t& count, uint32_t& flags, int threads, string& error)
+{
+	// Binary files are mapped and used as they are
+	if( isPointFile(path) )
+		return openPointFile(path, file, data, count, flags, error);
+
+	// Read the points straight from the file
+	flags = 0;
+	if( !loadPointsFile(path, storage, threads, error) )
+		return false;
+
+	data = storage.data();
+	count = storage.size();
+	return true;
+}
+
+
+/**
+ *	@brief	Build a kd-tree index file, or answer queries from one.
+ *	
+ *	"closest index build POINTS INDEX" builds the tree over a point file and saves it.
+ *	"closest index query INDEX QUERIES" loads it and prints the nearest indexed point of every
+ *	point in QUERIES, or with "--pair" the closest pair each query point is part of.  Both take
+ *	"--threads N".
+ *	
+ *	@param argc		Argument count, argv[1] is "index"
+ *	@param argv		Arguments
+ *	
+ *	@return Zero on success.
+ */
+int runIndex(int argc, char* argv[])
+{
+	int threads = max(1u, thread::hardware_concurrency());
+	bool involving = false;
+	vector<string> files;
+	for(int a = 3; a < argc; a++)
+	{
+		if( equalIC(argv[a], "--threads") && a+1 < argc )
+			threads = max(1, atoi(argv[++a]));
+		else if( equalIC(argv[a], "--pair") )
+			involving = true;
+		else
+			files.push_back(argv[a]);
+	}
+
+	bool build = argc >= 3 && equalIC(argv[2], "BUILD");
+	bool query = argc >= 3 && equalIC(argv[2], "QUERY");
+	if( (!build && !query) || files.size() != 2 )
+	{
+		cout << "Usage: closest index build POINTS INDEX" << endl;
+		cout << "       closest index query INDEX QUERIES [--pair] [--threads N]" << endl;
+		return 1;
+	}
+
+	vector<Point> storage;
+	MappedFile file;
+	const Point* data = nullptr;
+	size_t count = 0;
+	uint32_t flags;
+	string error;
+	if( !openPoints(build ? files[0] : files[1], storage, file, data, count, flags, threads, error) )
+	{
+		cout << "Error: " << error << endl;
+		return 1;
+	}
+
+	if( build )
+	{
+		KdTree tree(data, count);
+		if( !tree.save(files[1]) )
+		{
+			cout << "Error: could not write " << files[1] << endl;
+			return 1;
+		}
+		cout << "Indexed " << count << " points into " << files[1] << endl;
+		return 0;
+	}
+
+	KdTree tree;
+	if( !tree.load(files[0], error) )
+	{
+		cout << "Error: " << error << endl;
+		return 1;
+	}
+
+	vector<long long> found;
+	vector<Point> partners;
+	vector<long long> dist;
+	tree.nearestBatch(data, count, involving, threads, found, partners, dist);
+
+	for(size_t i = 0; i < count; i++)
+	{
+		cout << "(" << data[i].x << ", " << data[i].y << ") -> ";
+		if( found[i] < 0 )
+			cout << "none\n";
+		else
+			cout << "(" << partners[i].x << ", " << partners[i].y << ") #" << found[i]
+				<< "  Distance squared: " << dist[i] << "\n";
+	}
+	cout.flush();
+	return 0;
+}
+
+
+/**
+ *	@brief	Read input from the std input.  It should be "Brute", "Divide", "InPlace", "Parallel", "Grid",
+ *				"Sweep" or "Both".  Based
+ *				on what was entered, an algorithm type will be selected for the program.
+ *				
+ *	@return Which algorithm(s) the user selected.
+ */
+Algorithm getAlgorithm()
+{
+	string algorithm;
+
+	// Loop until we get a valid value for the algorithm type
+	while( true )
+	{
+		cout << "Please choose an algorithm (BRUTE, DIVIDE, INPLACE, PARALLEL, GRID, SWEEP, SHAMOS, ITERATIVE, BOTH): ";
+		getline(cin, algorithm);
+
+		// Check which algorithm was selected, ignoring case
+		if( equalIC(algorithm, "BRUTE"))
+		{
+			cout << "Brute force algorithm selected." << endl;
+			return BRUTE;
+		}
+		if( equalIC(algorithm, "DIVIDE"))
+		{
+			cout << "Divide and Conquer algorithm selected." << endl;
+			return DIVIDE;
+		}
+		if( equalIC(algorithm, "INPLACE"))
+		{
+			cout << "In place Divide and Conquer algorithm selected." << endl;
+			return INPLACE;
+		}
+		if( equalIC(algorithm, "PARALLEL"))
+		{
+			cout << "Parallel Divide and Conquer algorithm selected." << endl;
+			return PARALLEL;
+		}
+		if( equalIC(algorithm, "GRID"))
+		{
+			cout << "Randomized grid algorithm selected." << endl;
+			return GRID;
+		}
+		if( equalIC(algorithm, "SWEEP"))
+		{
+			cout << "Plane sweep algorithm selected." << endl;
+			return SWEEP;
+		}
+		if( equalIC(algorithm, "SHAMOS"))
+		{
+			cout << "Single presort Divide and Conquer algorithm selected." << endl;
+			return SHAMOS;
+		}
+		if( equalIC(algorithm, "ITERATIVE"))
+		{
+			cout << "Bottom up Divide and Conquer algorithm selected." << endl;
+			return ITERATIVE;
+		}
+		if( equalIC(algorithm, "BOTH"))
+		{
+			cout << "Both algorithms will be used." << endl;
+			return BOTH;
+		}
+
+		cout << "Unrecognized algorithm.\n\n";
+	}
+}
+
+
+/**
+ *	Points read in the narrowest coordinate type that holds all of them.  Only the vector of the
+ *	chosen type is filled.
+ */
+struct CompactPoints
+{
+	enum Type { INT16, INT32, INT64, FLOAT, DOUBLE };
+
+	Type type = INT32;
+	vector<BasicPoint<int16_t>> p16;
+	vector<BasicPoint<int32_t>> p32;
+	vector<BasicPoint<int64_t>> p64;
+	vector<BasicPoint<float>> pf;
+	vector<BasicPoint<double>> pd;
+};
+
+
+/**
+ *	@brief	Parse pairs of values straight into points of type T.
+ *	
+ *	@param count	Number of points to read, the values were already checked to be there
+ *	@param next		Moves to the next token and copies it into token
+ *	@param token	The current token, null terminated
+ *	@param real		True to parse the values as floating point, false as integers
+ *	@param out		Will hold the points
+ *	
+ *	@return Void.
+ */
+template<class T, class Next>
+void readCompactPoints(size_t count, Next& next, const char* token, bool real, vector<BasicPoint<T>>& out)
+{
+	auto value = [&]() -> T
+	{
+		next();
+		return real ? T(strtod(token, nullptr)) : T(strtoll(token, nullptr, 10));
+	};
+
+	out.clear();
+	out.reserve(count);
+	for(size_t i = 0; i < count; i++)
+	{
+		T x = value();
+		T y = value();
+		out.emplace_back(x, y);
+	}
+}
+
+
+/**
+ *	@brief	Parse the count then pairs format into the narrowest coordinate type that holds it.
+ *	
+ *	Integers are stored as int16 when they fit, as int32 within MAX_COORD and as int64 within
+ *	+-(2^62 - 1), the ranges over which two differences squared still fit each type's distance.
+ *	As soon as one value is not an integer every value is read as floating point, and stored as
+ *	float if all of them are exactly representable in a float, double otherwise.
+ *	
+ *	The text is read twice, first to pick the type and then straight into the points, so only
+ *	the points of the chosen type are ever held.
+ *	
+ *	@param begin	First character of the text
+ *	@param end		One past the last character
+ *	@param out		Will hold the points
+ *	@param error	Will hold the reason when the text is rejected
+ *	
+ *	@return True if the text was read.
+ */
+bool parseCompactPoints(const char* begin, const char* end, CompactPoints& out, string& error)
+{
+	const char* p = begin;
+	long long line = 1;
+	char token[64];
+
+	// Copy the next token out, the text is not null terminated
+	auto next = [&]() -> int
+	{
+		while( p < end && isBlank(*p) )
+		{
+			line += *p == '\n';
+			p++;
+		}
+
+		int len = 0;
+		while( p < end && !isBlank(*p) )
+		{
+			if( len < int(sizeof(token)) - 1 )
+				token[len] = *p;
+			len++;
+			p++;
+		}
+		token[min(len, int(sizeof(token)) - 1)] = 0;
+		return len;
+	};
+
+	char* stop;
+	long long count = -1;
+	if( next() > 0 )
+	{
+		errno = 0;
+		count = strtoll(token, &stop, 10);
+		if( *stop != 0 || errno != 0 )
+			count = -1;
+	}
+	if( count < 0 )
+	{
+		error = "line " + to_string(line) + ": expected a positive point count";
+		return false;
+	}
+
+	// First pass, only check the values and find the range they need
+	const char* values = p;
+	long long found = 0;
+	long long lo = 0, hi = 0;
+	bool real = false;
+	bool fitsFloat = true;
+	while( next() > 0 )
+	{
+		found++;
+		if( !real )
+		{
+			errno = 0;
+			long long v = strtoll(token, &stop, 10);
+			if( *stop == 0 && errno == 0 )
+			{
+				lo = min(lo, v);
+				hi = max(hi, v);
+				fitsFloat = fitsFloat && double(float(v)) == double(v);
+				continue;
+			}
+
+			// Not an integer, everything is floating point from here on
+			real = true;
+		}
+
+		double v = strtod(token, &stop);
+		if( *stop != 0 )
+		{
+			error = "line " + to_string(line) + ": \"" + token + "\" is not a number";
+			return false;
+		}
+
+		// A NaN fails every comparison and an infinity every difference, the search can't use either
+		if( !isfinite(v) )
+		{
+			error = "line " + to_string(line) + ": \"" + token + "\" is not a finite number";
+			return false;
+		}
+		fitsFloat = fitsFloat && double(float(v)) == v;
+	}
+
+	if( found != count * 2 )
+	{
+		error = "expected " + to_string(count) + " points, found " + to_string(found / 2)
+			+ (found % 2 ? " and a lone value" : "");
+		return false;
+	}
+
+	// Second pass, parse again straight into the narrowest type
+	p = values;
+	if( real )
+	{
+		out.type = fitsFloat ? CompactPoints::FLOAT : CompactPoints::DOUBLE;
+		if( fitsFloat )
+			readCompactPoints(count, next, token, true, out.pf);
+		else
+			readCompactPoints(count, next, token, true, out.pd);
+		return true;
+	}
+
+	if( lo >= INT16_MIN && hi <= INT16_MAX )
+	{
+		out.type = CompactPoints::INT16;
+		readCompactPoints(count, next, token, false, out.p16);
+	}
+	else if( inCoordRange(lo) && inCoordRange(hi) )
+	{
+		out.type = CompactPoints::INT32;
+		readCompactPoints(count, next, token, false, out.p32);
+	}
+	else if( lo > -(1LL << 62) && hi < (1LL << 62) )
+	{
+		out.type = CompactPoints::INT64;
+		readCompactPoints(count, next, token, false, out.p64);
+	}
+	else
+	{
+		error = "coordinates must be within +-(2^62 - 1)";
+		return false;
+	}
+	return true;
+}
+
+
+//! Squared distances as text, WideDist has no stream operator
+string distText(long long v)
+{
+	return to_string(v);
+}
+
+string distText(double v)
+{
+	ostringstream out;
+	out << v;
+	return out.str();
+}
+
+#ifdef __SIZEOF_INT128__
+string distText(__int128 v)
+{
+	if( v >= LLONG_MIN && v <= LLONG_MAX )
+		return to_string((long long)v);
+
+	string digits;
+	bool negative = v < 0;
+	unsigned __int128 u = negative ? -(unsigned __int128)v : v;
+	while( u > 0 )
+	{
+		digits += char('0' + int(u % 10));
+		u /= 10;
+	}
+	if( negative )
+		digits += '-';
+	return string(digits.rbegin(), digits.rend());
+}
+#else
+string distText(long double v)
+{
+	return distText(double(v));
+}
+#endif
+
+
+void printStats(bool showCalls);
+
+/**
+ *	@brief	Run the in place divide and conquer on compact points and print the result.
+ *	
+ *	@param P	The points, at least 2
+ *	
+ *	@return Void.
+ */
+template<class T>
+void printCompactResult(const vector<BasicPoint<T>>& P)
+{
+	resetStats();
+
+	pair<BasicPoint<T>, BasicPoint<T>> closest{P[0], P[1]};
+	typename CoordTraits<T>::Dist ds = compactClosestPoint(P.data(), P.size(), closest);
+
+	cout << "Algorithm: Divide and Conquer (in place, " << CoordTraits<T>::name() << " coordinates)\n\n";
+	cout << "N: " << P.size() << "\n\n";
+	cout << "Point 1: (" << +closest.first.x << ", " << +closest.first.y << ")\n";
+	cout << "Point 2: (" << +closest.second.x << ", " << +closest.second.y << ")\n\n";
+	cout << "Distance squared: " << distText(ds) << "\n\n";
+	cout << "Distance: " << sqrt((long double)ds) << "\n\n";
+	cout << "Point memory: " << P.size() * sizeof(BasicPoint<T>) << " bytes\n";
+	printStats(true);
+}
+
+
+/**
+ *	@brief	Read points from a text file, or std input when path is empty, in the narrowest
+ *			coordinate type that holds them and find their closest pair.
+ *	
+ *	@param path		Text point file, empty for std input
+ *	
+ *	@return Zero on success.
+ */
+int runCompact(const string& path)
+{
+	CompactPoints compact;
+	string error;
+	bool read;
+
+	if( path.empty() )
+	{
+		string text((istreambuf_iterator<char>(cin)), istreambuf_iterator<char>());
+		read = parseCompactPoints(text.data(), text.data() + text.size(), compact, error);
+	}
+	else
+	{
+		MappedFile file;
+		if( !file.open(path) )
+		{
+			cout << "Error: could not open " << path << endl;
+			return 1;
+		}
+		read = parseCompactPoints(file.data(), file.data() + file.size(), compact, error);
+	}
+
+	if( !read )
+	{
+		cout << "Error: " << error << endl;
+		return 1;
+	}
+
+	size_t n = max(max(compact.p16.size(), compact.p32.size()), max(compact.p64.size(), max(compact.pf.size(), compact.pd.size())));
+	if( n < 2 )
+	{
+		cout << "Error: n = " << n << ". Should be >= 2" << endl;
+		return 1;
+	}
+
+	switch( compact.type )
+	{
+		case CompactPoints::INT16:	printCompactResult(compact.p16); break;
+		case CompactPoints::INT32:	printCompactResult(compact.p32); break;
+		case CompactPoints::INT64:	printCompactResult(compact.p64); break;
+		case CompactPoints::FLOAT:	printCompactResult(compact.pf); break;
+		case CompactPoints::DOUBLE:	printCompactResult(compact.pd); break;
+	}
+	return 0;
+}
+
+
+/**
+ *	@brief	Where the calibrated cutoff is cached.
+ *	
+ *	@return $CLOSEST_CONFIG if it is set, otherwise .closest_pair.cfg in the home directory.
+ */
+string cutoffConfigPath()
+{
+	const char* path = getenv("CLOSEST_CONFIG");
+	if( path && *path )
+		return path;
+
+#ifdef _WIN32
+	const char* home = getenv("USERPROFILE");
+#else
+	const char* home = getenv("HOME");
+#endif
+	return string(home && *home ? home : ".") + "/.closest_pair.cfg";
+}
+
+
+/**
+ *	@brief	Read the cached cutoff, if it was calibrated with the kernel in use.
+ *	
+ *	The file holds "kernel NAME" and "cutoff N" lines.
+ *	
+ *	@param cutoff	Will hold the cached cutoff
+ *	
+ *	@return True if there was a usable cached cutoff.
+ */
+bool readCachedCutoff(int& cutoff)
+{
+	ifstream in(cutoffConfigPath());
+	string key, kernel;
+	int value = 0;
+	while( in >> key )
+	{
+		if( key == "kernel" )
+			in >> kernel;
+		else if( key == "cutoff" )
+			in >> value;
+		else
+			in.ignore(numeric_limits<streamsize>::max(), '\n');
+	}
+
+	if( kernel != bruteForceKernelName() || value < DEFAULT_CUTOFF || value > MAX_CUTOFF )
+		return false;
+	cutoff = value;
+	return true;
+}
+
+
+/**
+ *	@brief	Find the fastest base case size on this CPU.
+ *	
+ *	Every candidate cutoff runs the in place divide and conquer on the same presorted random
+ *	points, the presorts are not timed.  The candidate with the lowest median time wins.
+ *	
+ *	@param verbose	Print the time of every candidate
+ *	
+ *	@return The fastest cutoff.
+ */
+int calibrateCutoff(bool verbose)
+{
+	typedef chrono::steady_clock Clock;
+	const int n = 1 << 17;
+	const int reps = 5;
+
+	mt19937_64 rng(1);
+	vector<Point> P;
+	P.reserve(n);
+	for(int i = 0; i < n; i++)
+		P.emplace_back(int(rng() % (1u << 30)), int(rng() % (1u << 30)));
+	sortByX(P);
+
+	vector<pair<Point, const Point*>> Q;
+	Q.reserve(n);
+	for(int i = 0; i < n; i++)
+		Q.emplace_back(P[i], &P[i]);
+	sortByY(Q);
+	vector<pair<Point, const Point*>> S(Q);
+	StripBuffer strip(n);
+
+	int saved = selected_cutoff;
+	int best = DEFAULT_CUTOFF;
+	double bestMs = 0;
+	if( verbose )
+		cout << "cutoff\tmedian ms" << endl;
+
+	for(int cutoff : {3, 4, 6, 8, 12, 16, 24, 32, 48, 64})
+	{
+		selected_cutoff = min(cutoff, MAX_CUTOFF);
+		vector<double> times;
+		for(int r = 0; r < reps; r++)
 		{
-			PR.push_back(P[i]);
+			// The search leaves Q sorted by y again, so every run starts from the same state
+			pair<Point, Point> closest{P[0], P[1]};
+			Clock::time_point start = Clock::now();
+			divideClosestRangeSearch(P.data(), Q.data(), S.data(), strip, 0, n, closest);
+			times.push_back(chrono::duration<double, milli>(Clock::now() - start).count());
 		}
+		sort(times.begin(), times.end());
+		double ms = times[reps / 2];
 
-		// Copy the same points of PL and PR, but maintain the Y sort order
-		vector<pair<Point, Point*>> QL;
-		vector<pair<Point, Point*>> QR;
-		for(auto& q : Q)
+		if( verbose )
+			cout << selected_cutoff << "\t" << ms << endl;
+		if( selected_cutoff == DEFAULT_CUTOFF || ms < bestMs )
 		{
-			if( q.first.x < mid)
-				QL.push_back(q);
-			else
-				QR.push_back(q);
+			best = selected_cutoff;
+			bestMs = ms;
 		}
+	}
 
-		// Find the closest pair on the left
-		pair<Point, Point> cl{PL[0], PL[1]};
-		double dl = divideClosetPointSearch(PL, QL, cl);
+	selected_cutoff = saved;
+	return best;
+}
 
-		// Find the closest pair on the right
-		pair<Point, Point> cr{PR[0], PR[1]};
-		double dr = divideClosetPointSearch(PR, QR, cr);
 
-		// Find the closest of the two
-		double d;
-		if( dl < dr)
+/**
+ *	@brief	Calibrate the cutoff and cache it for later runs.
+ *	
+ *	@param verbose	Print the time of every candidate
+ *	
+ *	@return The calibrated cutoff.
+ */
+int calibrateAndCacheCutoff(bool verbose)
+{
+	int cutoff = calibrateCutoff(verbose);
+
+	string path = cutoffConfigPath();
+	ofstream out(path);
+	out << "kernel " << bruteForceKernelName() << "\n";
+	out << "cutoff " << cutoff << "\n";
+	if( verbose )
+	{
+		cout << "Fastest cutoff with the " << bruteForceKernelName() << " kernel: " << cutoff << endl;
+		if( out )
+			cout << "Saved to " << path << endl;
+		else
+			cout << "Could not save to " << path << endl;
+	}
+	return cutoff;
+}
+
+
+/**
+ *	@brief	Set selected_cutoff from a "--cutoff" value.
+ *	
+ *	@param value	A number of points, clamped to [3, 64], or "auto" for the cached calibration
+ *	
+ *	@return Void.
+ */
+void applyCutoff(const string& value)
+{
+	if( equalIC(value, "auto") )
+	{
+		if( !readCachedCutoff(selected_cutoff) )
+			selected_cutoff = calibrateAndCacheCutoff(false);
+	}
+	else
+		selected_cutoff = max(DEFAULT_CUTOFF, min(MAX_CUTOFF, atoi(value.c_str())));
+}
+
+
+//! One engine the benchmark can time
+struct BenchEngine
+{
+	const char* name;
+	size_t maxN;
+	function<long long(vector<Point>&, pair<Point, Point>&)> run;
+};
+
+//! Timings of one engine at one N
+struct BenchResult
+{
+	string engine;
+	size_t n;
+	double medianMs, p95Ms, minMs;
+	double pointsPerSec;
+	long long peakRssKb;
+	long long calcs;
+	long long depth;
+	long long distance;
+};
+
+
+/**
+ *	@brief	Start the peak resident set size over from the current size, so the next peakRssKb
+ *			only covers what runs after this.
+ *	
+ *	@return False where the peak can not be reset, peakRssKb is then the peak of the whole process.
+ */
+bool resetPeakRss()
+{
+#if defined(__linux__)
+	// Writing 5 to clear_refs resets VmHWM, Linux 4.0 and later
+	ofstream out("/proc/self/clear_refs");
+	out << "5" << flush;
+	return bool(out);
+#else
+	return false;
+#endif
+}
+
+/**
+ *	@brief	Peak resident set size since the last resetPeakRss, or of the process so far.
+ *	
+ *	@return Peak RSS in KB, zero where it can not be read.
+ */
+long long peakRssKb()
+{
+#if defined(__linux__)
+	// ru_maxrss is not reset by clear_refs, VmHWM is
+	ifstream status("/proc/self/status");
+	string line;
+	while( getline(status, line) )
+	{
+		if( line.compare(0, 6, "VmHWM:") == 0 )
+			return atoll(line.c_str() + 6);
+	}
+#endif
+
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters;
+	if( GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) )
+		return counters.PeakWorkingSetSize / 1024;
+	return 0;
+#else
+	rusage usage;
+	if( getrusage(RUSAGE_SELF, &usage) != 0 )
+		return 0;
+	#ifdef __APPLE__
+		return usage.ru_maxrss / 1024;
+	#else
+		return usage.ru_maxrss;
+	#endif
+#endif
+}
+
+
+/**
+ *	@brief	Parse a comma separated list of sizes such as "1000,1e5,1000000".
+ *	
+ *	@param text		The list
+ *	@param sizes	Will hold the sizes
+ *	
+ *	@return True if every entry was a size of at least 2.
+ */
+bool parseSizes(const string& text, vector<size_t>& sizes)
+{
+	sizes.clear();
+	size_t start = 0;
+	while( start <= text.size() )
+	{
+		size_t end = text.find(',', start);
+		if( end == string::npos )
+			end = text.size();
+
+		double value = atof(text.substr(start, end - start).c_str());
+		if( value < 2 || value > 1e18 )
+			return false;
+		sizes.push_back(size_t(value));
+		start = end + 1;
+	}
+	return !sizes.empty();
+}
+
+
+/**
+ *	@brief	Wall clock benchmark of every engine over a set of N values.
+ *	
+ *	Every engine gets the same random points for a given N, drawn from one of three data sets:
+ *	"uniform" over [0, 2^30)^2, "dups" over getRandomPoint's [0, 2000)^2, where large N repeats
+ *	every x many times, and "columns", 16 survey lines of equal x with random y.  Each timed run gets a fresh copy of
+ *	them, since the engines sort their input, and only the search itself is timed, on the monotonic
+ *	clock.  The warm up runs are not recorded.  All engines must agree on the closest distance.
+ *	The peak RSS is reset before every engine and N, so it is the peak while that engine ran,
+ *	the input points included.  Where it can't be reset the column is named process peak RSS
+ *	and only ever grows.
+ *	
+ *	Options:
+ *		--sizes A,B,C	N values, default 1000,10000,100000,1000000
+ *		--reps R		Timed runs per engine and N, default 5
+ *		--warmup W		Untimed runs first, default 1
+ *		--engines L		Comma separated engines to run, default all of them
+ *		--brute-max N	Largest N brute force is run on, default 20000
+ *		--data D		uniform, dups or columns, default uniform
+ *		--json FILE		Also write the results as JSON
+ *		--csv FILE		Also write the results as CSV
+ *		--threads N, --seed S, --cutoff N|auto as for the normal run
+ *	
+ *	@param argc		Argument count, argv[1] is "bench"
+ *	@param argv		Arguments
+ *	
+ *	@return Zero if every engine agreed and the output files were written.
+ */
+int runBenchmark(int argc, char* argv[])
+{
+	typedef chrono::steady_clock Clock;
+
+	vector<size_t> sizes{1000, 10000, 100000, 1000000};
+	int reps = 5;
+	int warmup = 1;
+	size_t bruteMax = 20000;
+	int threads = max(1u, thread::hardware_concurrency());
+	unsigned long long seed = 1;
+	string engineList, jsonPath, csvPath;
+	string data = "uniform";
+
+	for(int a = 2; a < argc; a++)
+	{
+		bool hasValue = a+1 < argc;
+		if( equalIC(argv[a], "--sizes") && hasValue )
 		{
-			closest = cl;
-			d = dl;
+			if( !parseSizes(argv[++a], sizes) )
+			{
+				cout << "Error: --sizes takes a comma separated list of N values of at least 2" << endl;
+				return 1;
+			}
+		}
+		else if( equalIC(argv[a], "--reps") && hasValue )
+			reps = max(1, atoi(argv[++a]));
+		else if( equalIC(argv[a], "--warmup") && hasValue )
+			warmup = max(0, atoi(argv[++a]));
+		else if( equalIC(argv[a], "--engines") && hasValue )
+			engineList = argv[++a];
+		else if( equalIC(argv[a], "--brute-max") && hasValue )
+			bruteMax = strtoull(argv[++a], nullptr, 10);
+		else if( equalIC(argv[a], "--json") && hasValue )
+			jsonPath = argv[++a];
+		else if( equalIC(argv[a], "--csv") && hasValue )
+			csvPath = argv[++a];
+		else if( equalIC(argv[a], "--threads") && hasValue )
+			threads = max(1, atoi(argv[++a]));
+		else if( equalIC(argv[a], "--seed") && hasValue )
+			seed = strtoull(argv[++a], nullptr, 10);
+		else if( equalIC(argv[a], "--cutoff") && hasValue )
+			applyCutoff(argv[++a]);
+		else if( equalIC(argv[a], "--data") && hasValue )
+		{
+			data = argv[++a];
+			for(char& ch : data)
+				ch = tolower(ch);
+			if( data != "uniform" && data != "dups" && data != "columns" )
+			{
+				cout << "Error: --data takes uniform, dups or columns" << endl;
+				return 1;
+			}
 		}
 		else
 		{
-			closest = cr;
-			d = dr;
+			cout << "Error: unknown benchmark option " << argv[a] << endl;
+			return 1;
 		}
+	}
+
+	vector<BenchEngine> engines{
+		{"brute", bruteMax, [](vector<Point>& P, pair<Point, Point>& c) { return bruteForceClosestPair(P, c); }},
+		{"divide", SIZE_MAX, [](vector<Point>& P, pair<Point, Point>& c) { return divideClosestPoint(P, c); }},
+		{"inplace", SIZE_MAX, [](vector<Point>& P, pair<Point, Point>& c) { return divideClosestPoint(P, c, true); }},
+		{"parallel", SIZE_MAX, [threads](vector<Point>& P, pair<Point, Point>& c) { return parallelClosestPoint(P, c, threads); }},
+		{"grid", SIZE_MAX, [seed](vector<Point>& P, pair<Point, Point>& c) { return gridClosestPoint(P, c, seed); }},
+		{"sweep", SIZE_MAX, [](vector<Point>& P, pair<Point, Point>& c) { return sweepClosestPoint(P, c); }},
+		{"shamos", SIZE_MAX, [](vector<Point>& P, pair<Point, Point>& c) { return shamosClosestPoint(P, c); }},
+		{"iterative", SIZE_MAX, [](vector<Point>& P, pair<Point, Point>& c) { return iterativeClosestPoint(P, c); }},
+	};
 
-		// Copy all points within d of the middle into S, this forms the strips
-		vector< pair<Point, Point*> > S;
-		int size = 0;
-		for( auto& q : Q)
+	if( !engineList.empty() )
+	{
+		vector<BenchEngine> chosen;
+		for(const BenchEngine& e : engines)
 		{
-			if(abs(q.first.x - mid) <= d)
-			{
-				S.push_back(q);
-				size++;
-			}
+			string padded = "," + engineList + ",";
+			for(char& ch : padded)
+				ch = tolower(ch);
+			if( padded.find("," + string(e.name) + ",") != string::npos )
+				chosen.push_back(e);
+		}
+		if( chosen.empty() )
+		{
+			cout << "Error: --engines matched none of brute, divide, inplace, parallel, grid, sweep, shamos, iterative" << endl;
+			return 1;
 		}
+		engines = chosen;
+	}
+
+	vector<BenchResult> results;
+	bool agreed = true;
+
+	// Where the peak can't be reset, say that the column is the peak of the whole run
+	bool rssPerEngine = resetPeakRss();
+	string rssName = rssPerEngine ? "peak RSS KB" : "process peak RSS KB";
+	string rssKey = rssPerEngine ? "peak_rss_kb" : "process_peak_rss_kb";
 
-		// Used so we don't have to do sqrt inside the loop
-		double dminsq = pow(d, 2);
+	cout << "engine\tN\tmedian ms\tp95 ms\tmin ms\tpoints/s\t" << rssName << "\tcalcs\tdepth" << endl;
+	for(size_t n : sizes)
+	{
+		mt19937_64 rng(seed ^ (unsigned long long)n);
+		vector<Point> base;
+		base.reserve(n);
+		for(size_t i = 0; i < n; i++)
+		{
+			if( data == "dups" )
+				base.emplace_back(int(rng() % 2000), int(rng() % 2000));
+			else if( data == "columns" )
+				base.emplace_back(int(rng() % 16) * 1000, int(rng() % (1u << 30)));
+			else
+				base.emplace_back(int(rng() % (1u << 30)), int(rng() % (1u << 30)));
+		}
 
-		// Loop through all points inside the strip and see if any are closer then dminsq
-		for( int i = 0; i < size; i++)
+		long long expected = -1;
+		for(const BenchEngine& e : engines)
 		{
-			int k = i+1;
-			while(k < size && (pow(S[i].first.y - S[k].first.y, 2) < dminsq  ))
+			if( n > e.maxN )
+				continue;
+
+			vector<double> times;
+			long long ds = 0;
+			long long calcs = 0;
+			long long depth = 0;
+			resetPeakRss();
+			for(int r = 0; r < warmup + reps; r++)
 			{
-				// Running a distance calculation
-				DISTANCE_CALCULATIONS += 1;
-				double dist = pow(S[i].first.x - S[k].first.x, 2) + pow(S[i].first.y - S[k].first.y, 2);
-				
-				// Distance was less, so the points are closer across the middle than the left or right half
-				if( dist < dminsq)
-				{
-					dminsq = dist;
-					closest.first = S[i].first;
-					closest.second = S[k].first;
-				}
+				vector<Point> P(base);
+				pair<Point, Point> closest{P[0], P[1]};
+				resetStats();
+
+				Clock::time_point start = Clock::now();
+				ds = e.run(P, closest);
+				double ms = chrono::duration<double, milli>(Clock::now() - start).count();
 
-				k++;
+				calcs = STATS.distanceCalcs;
+				depth = STATS.maxDepth;
+				if( r >= warmup )
+					times.push_back(ms);
 			}
+
+			if( expected < 0 )
+				expected = ds;
+			else if( ds != expected )
+			{
+				cout << "Error: " << e.name << " found distance squared " << ds << " at N " << n
+					<< ", expected " << expected << endl;
+				agreed = false;
+			}
+
+			// Nearest rank percentiles
+			sort(times.begin(), times.end());
+			BenchResult result;
+			result.engine = e.name;
+			result.n = n;
+			result.medianMs = times.size() % 2 ? times[times.size()/2]
+				: (times[times.size()/2 - 1] + times[times.size()/2]) / 2;
+			result.p95Ms = times[size_t(ceil(0.95 * times.size())) - 1];
+			result.minMs = times[0];
+			result.pointsPerSec = result.medianMs > 0 ? n / (result.medianMs / 1000) : 0;
+			result.peakRssKb = peakRssKb();
+			result.calcs = calcs;
+			result.depth = depth;
+			result.distance = ds;
+			results.push_back(result);
+
+			cout << result.engine << "\t" << n << "\t" << result.medianMs << "\t" << result.p95Ms << "\t"
+				<< result.minMs << "\t" << (long long)result.pointsPerSec << "\t" << result.peakRssKb
+				<< "\t" << calcs << "\t" << depth << endl;
+		}
+	}
+
+	bool written = true;
+	if( !jsonPath.empty() )
+	{
+		ofstream out(jsonPath);
+		out << "{\n  \"reps\": " << reps << ",\n  \"warmup\": " << warmup << ",\n  \"threads\": " << threads
+			<< ",\n  \"seed\": " << seed << ",\n  \"data\": \"" << data << "\",\n  \"results\": [\n";
+		for(size_t i = 0; i < results.size(); i++)
+		{
+			const BenchResult& r = results[i];
+			out << "    {\"engine\": \"" << r.engine << "\", \"n\": " << r.n << ", \"median_ms\": " << r.medianMs
+				<< ", \"p95_ms\": " << r.p95Ms << ", \"min_ms\": " << r.minMs << ", \"points_per_sec\": "
+				<< (long long)r.pointsPerSec << ", \"" << rssKey << "\": " << r.peakRssKb << ", \"distance_calcs\": "
+				<< r.calcs << ", \"recursion_depth\": " << r.depth << ", \"distance_squared\": " << r.distance << "}" << (i+1 < results.size() ? "," : "") << "\n";
+		}
+		out << "  ]\n}\n";
+		if( !out )
+		{
+			cout << "Error: could not write " << jsonPath << endl;
+			written = false;
+		}
+	}
+
+	if( !csvPath.empty() )
+	{
+		ofstream out(csvPath);
+		out << "engine,n,data,reps,warmup,threads,median_ms,p95_ms,min_ms,points_per_sec," << rssKey << ",distance_calcs,recursion_depth,distance_squared\n";
+		for(const BenchResult& r : results)
+			out << r.engine << "," << r.n << "," << data << "," << reps << "," << warmup << "," << threads << "," << r.medianMs << ","
+				<< r.p95Ms << "," << r.minMs << "," << (long long)r.pointsPerSec << "," << r.peakRssKb << ","
+				<< r.calcs << "," << r.depth << "," << r.distance << "\n";
+		if( !out )
+		{
+			cout << "Error: could not write " << csvPath << endl;
+			written = false;
 		}
+	}
+
+	return agreed && written ? 0 : 1;
+}
+
+
+/**
+ *	@brief	Squared distance from q to the closest of n points by checking every one of them.
+ *	
+ *	@param points	Points to check
+ *	@param n		Number of points
+ *	@param q		Query point
+ *	@param skip		Index of a point to leave out, -1 for none
+ *	
+ *	@return The squared distance, LLONG_MAX if there is no point to check.
+ */
+long long bruteNearestDistance(const Point* points, size_t n, const Point& q, long long skip = -1)
+{
+	long long best = LLONG_MAX;
+	for(size_t j = 0; j < n; j++)
+		if( (long long)j != skip )
+			best = min(best, distSquared(points[j], q));
+	return best;
+}
+
+
+//! What every selftest check gets besides the points
+struct SelfTestContext
+{
+	mt19937_64 rng;
+	int threads;
+	long long range;	//!< The coordinates are in [-range, range]
+	string indexPath;	//!< Scratch file for the index check
+
+	//! A random point in the range of this trial
+	Point randomPoint()
+	{
+		return Point(int((long long)(rng() % (2 * range + 1)) - range), int((long long)(rng() % (2 * range + 1)) - range));
+	}
+};
+
+//! A selftest check returns an empty string if it passed, otherwise what went wrong first
+typedef string (*SelfTestFunction)(const vector<Point>& points, SelfTestContext& context);
 
-		return sqrt(dminsq);
+
+/**
+ *	@brief	Insert the points into an IncrementalClosestPair one at a time, checking the closest pair
+ *			against brute force after every insert, then insert them again as two batches.
+ *	
+ *	@return An empty string, or the first answer that was wrong.
+ */
+string selfTestIncremental(const vector<Point>& points, SelfTestContext& context)
+{
+	size_t n = points.size();
+	IncrementalClosestPair incremental;
+	long long expected = LLONG_MAX;
+	for(size_t i = 0; i < n; i++)
+	{
+		expected = min(expected, bruteNearestDistance(points.data(), i, points[i]));
+		incremental.insert(points[i]);
+		if( incremental.distance() != expected
+			|| (i > 0 && distSquared(incremental.closest().first, incremental.closest().second) != expected) )
+			return "after " + to_string(i + 1) + " points got " + to_string(incremental.distance()) + ", brute force " + to_string(expected);
 	}
+
+	size_t split = context.rng() % (n + 1);
+	IncrementalClosestPair batched;
+	batched.insert(points.data(), split);
+	batched.insert(points.data() + split, n - split);
+	if( batched.size() != n || batched.distance() != expected )
+		return "batches of " + to_string(split) + " and " + to_string(n - split) + " got " + to_string(batched.distance())
+			+ ", brute force " + to_string(expected);
+	return "";
 }
 
 
 /**
- *	@brief	Using a divide an conquer algorith, find the closest points and the distance between them.
- *	
- *	This purpose of this function is not to run the algorith but to set up the data structures
- *	that will allow it to be run more efficiently.  The points in the dataset will be first copied into
- *	a new vector, P, and merge sorted by their X component.  Thos points are then copied into a new vector,
- *	Q, which is merge sorted by the Y component.  The trick to making it work, is that the points in Q keep
- *	a pointer to their matching point in P.  This allows us to only sort the points a single time, but still
- *	correctly distribute for the algorithm.
- *	
- *	@param points		Vector of Points to find the closest pair in.
- *	@param closestPair	A copy of the two closest points will be stored in closest pair
+ *	@brief	Squared distance of the closest pair of points [from, to) by checking every pair.
  *	
- *	@return The Euclidean Distance between the two closest point.
+ *	@return The squared distance, LLONG_MAX with fewer than two points.
  */
-double divideClosestPoint( vector<Point>& points, pair<Point, Point>& closestPair )
+long long bruteClosestDistance(const Point* points, size_t from, size_t to)
 {
-	//copy points into P and sort by X
-	vector< Point> P = points;
-	mergeSort(P, 0, P.size()-1);
+	long long best = LLONG_MAX;
+	for(size_t i = from; i < to; i++)
+		for(size_t j = i + 1; j < to; j++)
+			best = min(best, distSquared(points[i], points[j]));
+	return best;
+}
 
-	
-	//copy points from P into Q with a pointer to the value in P
-	vector<pair<Point, Point*>> Q;
-	for( int i = 0; i < int(P.size()); i++)
-		Q.emplace_back(P[i], &P[i]);
 
-	//sort Q by Y
-	mergeSort(Q, 0, Q.size()-1);
-	
+/**
+ *	@brief	Stream the points through a fixed size SlidingWindowClosestPair and through one that is
+ *			only shrunk by expireBefore, checking both against brute force over the window.
+ *	
+ *	@return An empty string, or the first answer that was wrong.
+ */
+string selfTestWindow(const vector<Point>& points, SelfTestContext& context)
+{
+	size_t n = points.size();
+	size_t window = 2 + context.rng() % (n - 1);
+	SlidingWindowClosestPair fixed(window);
+	SlidingWindowClosestPair timed(0);
+	for(size_t i = 0; i < n; i++)
+	{
+		size_t first = i + 1 > window ? i + 1 - window : 0;
+		long long expected = bruteClosestDistance(points.data(), first, i + 1);
+
+		fixed.insert(points[i], i);
+		if( fixed.size() != i + 1 - first || fixed.distance() != expected
+			|| (expected != LLONG_MAX && distSquared(fixed.closest().first, fixed.closest().second) != expected) )
+			return "W " + to_string(window) + " at point " + to_string(i) + " got " + to_string(fixed.distance()) + ", brute force " + to_string(expected);
 
-	// Do the actual search
-	return divideClosetPointSearch(P, Q, closestPair);
+		timed.insert(points[i], i);
+		timed.expireBefore(first);
+		if( timed.size() != i + 1 - first || timed.distance() != expected )
+			return "expiring before " + to_string(first) + " at point " + to_string(i) + " got " + to_string(timed.distance())
+				+ ", brute force " + to_string(expected);
+	}
+	return "";
 }
 
 
 /**
- *	@brief		Compare two strings for equality, ignoring case.
- *	
- *	@param a	String to use for comparison
- *	@param b	String to compare A to
+ *	@brief	Check topKClosestPairs against the sorted distances of every pair, for a random k that
+ *			can be larger than the number of pairs.
  *	
- *	@return True is the strings are the same ignoring case, False otherwise
+ *	@return An empty string, or the first answer that was wrong.
  */
-bool equalIC(const string& a, const string& b)
+string selfTestTopK(const vector<Point>& points, SelfTestContext& context)
 {
-	// if they are identical, the language can handle that
-	if( a == b ) return true;
+	size_t n = points.size();
+	vector<long long> all;
+	for(size_t i = 0; i < n; i++)
+		for(size_t j = i + 1; j < n; j++)
+			all.push_back(distSquared(points[i], points[j]));
+	sort(all.begin(), all.end());
 
-	bool areEqual = true;
+	int k = 1 + context.rng() % min<size_t>(all.size() + 2, 100);
+	vector<ClosePair> top = topKClosestPairs(points.data(), n, k);
+	if( top.size() != min<size_t>(k, all.size()) )
+		return "k " + to_string(k) + " gave " + to_string(top.size()) + " pairs";
 
-	// must be same length
-	if( a.length() != b.length() )
-		areEqual = false;
+	for(size_t i = 0; i < top.size(); i++)
+		if( top[i].dist != all[i] || distSquared(top[i].a, top[i].b) != top[i].dist )
+			return "pair " + to_string(i) + " of " + to_string(k) + " has " + to_string(top[i].dist) + ", brute force " + to_string(all[i]);
+	return "";
+}
 
-	// compare each char
-	for( int i = 0; i < a.length() && areEqual; i++)
+
+/**
+ *	@brief	Check allNearestNeighbours against the brute force nearest other point of every point.
+ *	
+ *	@return An empty string, or the first answer that was wrong.
+ */
+string selfTestAllNearest(const vector<Point>& points, SelfTestContext& context)
+{
+	size_t n = points.size();
+	vector<long long> nearest, dist;
+	allNearestNeighbours(points.data(), n, context.threads, nearest, dist);
+	for(size_t i = 0; i < n; i++)
 	{
-		// if they are not the same, we are done
-		if( toupper(a[i]) != toupper(b[i]))
-			areEqual = false;
+		long long expected = bruteNearestDistance(points.data(), n, points[i], i);
+		if( dist[i] != expected || nearest[i] < 0 || nearest[i] == (long long)i
+			|| distSquared(points[nearest[i]], points[i]) != expected )
+			return "point " + to_string(i) + " got " + to_string(dist[i]) + ", brute force " + to_string(expected);
 	}
-
-	return areEqual;
+	return "";
 }
 
 
 /**
- *	@brief		Read in an integer from std input.
+ *	@brief	Split the points into a red and a blue set at a random place and check
+ *			bichromaticClosestPair against every red blue pair.
  *	
- *	@return		The integer read from input.
+ *	@return An empty string, or the first answer that was wrong.
  */
-int getNextInt()
+string selfTestBichromatic(const vector<Point>& points, SelfTestContext& context)
 {
-	int input;
+	size_t n = points.size();
+	size_t redCount = 1 + context.rng() % (n - 1);
+	const Point* red = points.data();
+	const Point* blue = points.data() + redCount;
+	size_t blueCount = n - redCount;
 
-	// Continue trying to get a valid int.
-	while( !( cin >> input ) )
-	{
-		cout << "Bad input" << endl;
-		cin.clear();
-		string bad;
-		getline(cin, bad);
-	}
+	long long expected = LLONG_MAX;
+	for(size_t i = 0; i < redCount; i++)
+		expected = min(expected, bruteNearestDistance(blue, blueCount, red[i]));
 
-	return input;
+	pair<Point, Point> closest{red[0], blue[0]};
+	long long ds = bichromaticClosestPair(red, redCount, blue, blueCount, closest, context.threads);
+	if( ds != expected || distSquared(closest.first, closest.second) != ds )
+		return to_string(redCount) + " red and " + to_string(blueCount) + " blue got " + to_string(ds) + ", brute force " + to_string(expected);
+
+	// Equal distances must not go to whichever thread finished first
+	pair<Point, Point> single{red[0], blue[0]};
+	bichromaticClosestPair(red, redCount, blue, blueCount, single, 1);
+	if( single.first.x != closest.first.x || single.first.y != closest.first.y
+		|| single.second.x != closest.second.x || single.second.y != closest.second.y )
+		return "the pair changed with the thread count";
+
+	if( bichromaticClosestPair(red, redCount, blue, 0, single, context.threads) != LLONG_MAX
+		|| bichromaticClosestPair(red, 0, blue, blueCount, single, context.threads) != LLONG_MAX )
+		return "an empty set did not give LLONG_MAX";
+	return "";
 }
 
 
 /**
- *	@brief		Read in a positive number from std input.
+ *	@brief	Save a kd-tree index, load it again and check its nearest and closest pair queries
+ *			against brute force, for indexed points and for random ones.
  *	
- *	@return		A positive number entered by the user through std input.
+ *	@return An empty string, or the first answer that was wrong.
  */
-unsigned getNextPos()
+string selfTestKdIndex(const vector<Point>& points, SelfTestContext& context)
 {
-	bool valid = false;
-	int input;
+	size_t n = points.size();
+	string error;
+	KdTree loaded;
+	if( !KdTree(points.data(), n).save(context.indexPath) || !loaded.load(context.indexPath, error) )
+		return "could not save and load " + context.indexPath + (error.empty() ? "" : ": " + error);
+	if( loaded.size() != n )
+		return "loaded " + to_string(loaded.size()) + " of " + to_string(n) + " points";
 
-	// Contiue trying to get a valid pos int
-	while( !valid )
+	vector<Point> queries(points.begin(), points.begin() + min<size_t>(n, 32));
+	for(int i = 0; i < 32; i++)
+		queries.push_back(context.randomPoint());
+
+	vector<long long> found, involvingFound, nearestDist, involvingDist;
+	vector<Point> partners;
+	loaded.nearestBatch(queries.data(), queries.size(), false, context.threads, found, partners, nearestDist);
+	loaded.nearestBatch(queries.data(), queries.size(), true, context.threads, involvingFound, partners, involvingDist);
+	for(size_t i = 0; i < queries.size(); i++)
 	{
-		while( !( cin >> input ) )
-		{
-			cout << "Bad input" << endl;
-			cin.clear();
-			string bad;
-			getline(cin, bad);
-		}
+		// The pair a query is part of leaves out one copy of the query itself
+		long long self = -1;
+		for(size_t j = 0; j < n && self < 0; j++)
+			if( points[j].x == queries[i].x && points[j].y == queries[i].y )
+				self = j;
 
-		if(input < 0)
-			cout << "Must be positive." << endl;
-		else
-			valid = true;
+		long long near = bruteNearestDistance(points.data(), n, queries[i]);
+		long long involving = bruteNearestDistance(points.data(), n, queries[i], self);
+		if( nearestDist[i] != near || found[i] < 0 || distSquared(points[found[i]], queries[i]) != near
+			|| involvingDist[i] != involving || distSquared(partners[i], queries[i]) != involving )
+			return "query " + to_string(i) + " got " + to_string(nearestDist[i]) + " and " + to_string(involvingDist[i])
+				+ ", brute force " + to_string(near) + " and " + to_string(involving);
 	}
-
-	return input;
+	return "";
 }
 
 
+//! Every selftest check and its name
+const pair<const char*, SelfTestFunction> SELF_TEST_CHECKS[] = {
+	{"incremental", selfTestIncremental},
+	{"window", selfTestWindow},
+	{"top-k", selfTestTopK},
+	{"all-nn", selfTestAllNearest},
+	{"bichromatic", selfTestBichromatic},
+	{"kd index", selfTestKdIndex},
+};
+
+
 /**
- *	@brief	Read input from the std input.  It should be "Brute", "Divide" or "Both".  Based
- *				on what was entered, an algorithm type will be selected for the program.
- *				
- *	@return Which algorithm(s) the user selected.
+ *	@brief	Cross check the query engines against brute force on random point sets.
+ *	
+ *	Every trial draws up to N points in a random range, from a few units wide (many duplicates) up
+ *	to the full +-MAX_COORD, and runs every check in SELF_TEST_CHECKS on them.  Failures print the
+ *	trial so they can be replayed with the same seed.
+ *	
+ *	Options:
+ *		--trials T		Random point sets to check, default 50
+ *		--n N			Most points in a set, default 300
+ *		--threads N, --seed S as for the normal run
+ *	
+ *	@param argc		Argument count, argv[1] is "selftest"
+ *	@param argv		Arguments
+ *	
+ *	@return Zero if every check passed.
  */
-Algorithm getAlgorithm()
+int runSelfTest(int argc, char* argv[])
 {
-	string algorithm;
+	int trials = 50;
+	size_t maxN = 300;
+	SelfTestContext context;
+	context.threads = max(1u, thread::hardware_concurrency());
+	unsigned long long seed = 1;
 
-	// Loop until we get a valid value for the algorithm type
-	while( true )
+	for(int a = 2; a < argc; a++)
 	{
-		cout << "Please choose an algorithm (BRUTE, DIVIDE, BOTH): ";
-		getline(cin, algorithm);
-
-		// Check which algorithm was selected, ignoring case
-		if( equalIC(algorithm, "BRUTE"))
-		{
-			cout << "Brute force algorithm selected." << endl;
-			return BRUTE;
-		}
-		if( equalIC(algorithm, "DIVIDE"))
+		bool hasValue = a+1 < argc;
+		if( equalIC(argv[a], "--trials") && hasValue )
+			trials = max(1, atoi(argv[++a]));
+		else if( equalIC(argv[a], "--n") && hasValue )
+			maxN = max(2ull, strtoull(argv[++a], nullptr, 10));
+		else if( equalIC(argv[a], "--threads") && hasValue )
+			context.threads = max(1, atoi(argv[++a]));
+		else if( equalIC(argv[a], "--seed") && hasValue )
+			seed = strtoull(argv[++a], nullptr, 10);
+		else
 		{
-			cout << "Divide and Conquer algorithm selected." << endl;
-			return DIVIDE;
+			cout << "Error: unknown selftest option " << argv[a] << endl;
+			return 1;
 		}
-		if( equalIC(algorithm, "BOTH"))
+	}
+
+	const char* tempDir = getenv("TMPDIR");
+	if( !tempDir )
+		tempDir = getenv("TEMP");
+	context.indexPath = string(tempDir ? tempDir : ".") + "/closest_selftest_" + to_string(seed) + ".kdi";
+	context.rng.seed(seed);
+
+	const size_t checkCount = sizeof(SELF_TEST_CHECKS) / sizeof(SELF_TEST_CHECKS[0]);
+	vector<int> failures(checkCount, 0);
+	const long long ranges[] = {4, 64, 1 << 16, MAX_COORD};
+	for(int trial = 0; trial < trials; trial++)
+	{
+		size_t n = 2 + context.rng() % (maxN - 1);
+		context.range = ranges[trial % 4];
+		vector<Point> points;
+		points.reserve(n);
+		for(size_t i = 0; i < n; i++)
+			points.push_back(context.randomPoint());
+
+		for(size_t c = 0; c < checkCount; c++)
 		{
-			cout << "Both algorithms will be used." << endl;
-			return BOTH;
+			string detail = SELF_TEST_CHECKS[c].second(points, context);
+			if( !detail.empty() && failures[c]++ == 0 )
+				cout << "FAIL " << SELF_TEST_CHECKS[c].first << " (trial " << trial << "): " << detail << endl;
 		}
+	}
+	remove(context.indexPath.c_str());
 
-		cout << "Unrecognized algorithm.\n\n";
+	bool passed = true;
+	for(size_t c = 0; c < checkCount; c++)
+	{
+		cout << (failures[c] ? "FAIL" : "PASS") << "\t" << SELF_TEST_CHECKS[c].first << "\t" << trials - failures[c] << "/" << trials << endl;
+		passed = passed && failures[c] == 0;
 	}
+	return passed ? 0 : 1;
 }
 
+vector<Point> points;
+const Point* point_data = nullptr;
+size_t point_count = 0;
+bool points_sorted_x = false;
+MappedFile point_file;
+Algorithm selected_algorithm;
+int selected_threads = max(1u, thread::hardware_concurrency());
+unsigned long long selected_seed = 1;
+string selected_input;
+int selected_top_k = 0;
+bool selected_all_nn = false;
+bool selected_compact = false;
+int selected_dimension = 2;
+string selected_blue;
 
 /**
- *	@brief	Run iterations of each algorithm using random points.
- *				
+ *	@brief	Print the counters of the last run.
+ *	
+ *	@param showCalls	Also print the recursion counters and the per strip counts
+ *	
  *	@return Void.
  */
-void runTests( int maxN = 8192, int iterations = 100)
+void printStats(bool showCalls)
 {
-	int currentN = 8;
-	
-	cout << "Divide and Conquer" << endl;
-	while( currentN <= maxN)
+#ifdef CLOSEST_NO_STATS
+	(void)showCalls;
+	cout << "Counters were compiled out (CLOSEST_NO_STATS)" << endl;
+#else
+	cout << "Number of distance calcs: " << STATS.distanceCalcs << endl;
+	if( !showCalls )
+		return;
+
+	cout << "Number of calls: " << STATS.recursiveCalls << endl;
+	cout << "Base cases: " << STATS.baseCases << endl;
+	cout << "Recursion depth: " << STATS.maxDepth << endl;
+	if( STATS.strips > 0 )
 	{
-		int averageCalls = 0;
-		int averageCalcs = 0;
+		cout << "Strips: " << STATS.strips << endl;
+		cout << "Average strip size: " << double(STATS.stripPoints) / STATS.strips << endl;
+		cout << "Largest strip: " << STATS.largestStrip << endl;
+		cout << "Comparisons per strip point: "
+			<< (STATS.stripPoints > 0 ? double(STATS.stripComparisons) / STATS.stripPoints : 0.0) << endl;
+	}
+#endif
+}
 
-		// Run divides
-		for( int i = 0; i < iterations; i++)
-		{
-			DISTANCE_CALCULATIONS = 0;
-			RECURSIVE_CALLS = 0;
-			vector<Point> points;
 
-			// Generate the Points
-			for(int p = 0; p < currentN; p++)
-				points.emplace_back( getRandomPoint() );
+/**
+ *	@brief	Print the result of one algorithm run in the standard output format.
+ *	
+ *	@param name			Name of the algorithm that was run
+ *	@param closest		The two closest points that were found
+ *	@param ds			The exact squared distance between the two closest points
+ *	@param showCalls	Also print the number of recursive calls
+ *	
+ *	@return Void.
+ */
+void printResult(const string& name, const pair<Point, Point>& closest, long long ds, bool showCalls)
+{
+	// The square root is only ever taken here, for display
+	double distance = sqrt(double(ds));
+
+	cout << "Algorithm: " << name << "\n\n";
 
-			// Run the algorithm
-			pair<Point, Point> closest{points[0], points[1]};
-			double distance = divideClosestPoint(points, closest);
+	cout << "N: " << point_count << "\n\n";
 
-			averageCalcs += DISTANCE_CALCULATIONS;
-			averageCalls += RECURSIVE_CALLS;
-		}
+	cout << "Point 1: (" << closest.first.x << ", " << closest.first.y << ")\n";
+	cout << "Point 2: (" << closest.second.x << ", " << closest.second.y << ")\n\n";
 
-		averageCalls /= iterations;
-		averageCalcs /= iterations;
+	cout << "Distance squared: " << ds << "\n\n";
+	cout << "Distance: " << distance << "\n\n";
+	printStats(showCalls);
+}
 
-		cout << "\tN: " << currentN << endl;
-		cout << "\t\t iterations:    " << iterations << endl;
-		cout << "\t\t average calls: " << averageCalls << endl;
-		cout << "\t\t average calcs: " << averageCalcs << endl;
 
-		currentN *= 2;
+/**
+ *	@brief	Read D dimensional points, count first and then D ints per point, and find their
+ *			closest pair with the selected algorithm.
+ *	
+ *	"grid" runs the D dimensional grid, "brute" the brute force, "both" the divide and conquer
+ *	and the brute force, and every other algorithm the divide and conquer.
+ *	
+ *	@return Zero on success.
+ */
+template<int D>
+int runDimensionOf()
+{
+	vector<PointND<D>> P;
+	if( !selected_input.empty() )
+	{
+		ifstream in(selected_input);
+		long long count;
+		if( !(in >> count) || count < 0 )
+		{
+			cout << "Error: " << selected_input << " should start with a positive point count" << endl;
+			return 1;
+		}
+		P.resize(count);
+		for(long long i = 0; i < count; i++)
+		{
+			for(int k = 0; k < D; k++)
+			{
+				if( !(in >> P[i].c[k]) )
+				{
+					cout << "Error: " << selected_input << " ends inside point " << i+1 << " of " << count << endl;
+					return 1;
+				}
+				if( P[i].c[k] < -MAX_COORD_ND || P[i].c[k] > MAX_COORD_ND )
+				{
+					cout << "Error: " << selected_input << ": point " << i+1 << " has a coordinate outside +-" << MAX_COORD_ND << endl;
+					return 1;
+				}
+			}
+		}
+	}
+	else
+	{
+		cout << "Enter point count: ";
+		size_t count = getNextPos();
+		P.resize(count);
+		for(size_t i = 0; i < count; i++)
+			for(int k = 0; k < D; k++)
+				P[i].c[k] = getNextInt(MAX_COORD_ND);
 	}
-	
 
-	// Run brutes
-	currentN = 8;
-	
-	cout << "Brute Force" << endl;
-	while( currentN <= (maxN/2))
+	size_t n = P.size();
+	if( n < 2 )
 	{
-		int averageCalls = 0;
-		int averageCalcs = 0;
+		cout << "Error: n = " << n << ". Should be >= 2" << endl;
+		return 1;
+	}
 
-		// Run divides
-		for( int i = 0; i < iterations; i++)
+	auto print = [n](const string& name, const pair<PointND<D>, PointND<D>>& closest, long long ds, bool showCalls)
+	{
+		cout << "Algorithm: " << name << " (" << D << "D)\n\n";
+		cout << "N: " << n << "\n\n";
+		for(int p = 0; p < 2; p++)
 		{
-			DISTANCE_CALCULATIONS = 0;
-			RECURSIVE_CALLS = 0;
-			vector<Point> points;
-
-			// Generate the Points
-			for(int p = 0; p < currentN; p++)
-				points.emplace_back( getRandomPoint() );
+			const PointND<D>& q = p == 0 ? closest.first : closest.second;
+			cout << "Point " << p+1 << ": (";
+			for(int k = 0; k < D; k++)
+				cout << (k ? ", " : "") << q.c[k];
+			cout << ")\n";
+		}
+		cout << "\nDistance squared: " << ds << "\n\n";
+		cout << "Distance: " << sqrt(double(ds)) << "\n\n";
+		printStats(showCalls);
+	};
 
-			// Run the algorithm
-			pair<Point, Point> closest{points[0], points[1]};
-			double distance = bruteForceClosestPair(points, closest);
+	pair<PointND<D>, PointND<D>> closest{P[0], P[1]};
+	if( selected_algorithm == GRID )
+	{
+		resetStats();
+		long long ds = gridClosestPoint(P.data(), n, closest, selected_seed);
+		print("Randomized Grid (seed " + to_string(selected_seed) + ")", closest, ds, false);
+	}
+	else if( selected_algorithm != BRUTE )
+	{
+		resetStats();
+		long long ds = divideClosestPoint(P.data(), n, closest);
+		print("Divide and Conquer", closest, ds, true);
+	}
 
-			averageCalcs += DISTANCE_CALCULATIONS;
-		}
+	if( selected_algorithm == BOTH )
+		cout << "\n\n";
 
-		averageCalcs /= iterations;
+	if( selected_algorithm == BRUTE || selected_algorithm == BOTH )
+	{
+		resetStats();
+		long long ds = bruteForceClosestPair(P.data(), n, closest);
+		print("Brute Force", closest, ds, false);
+	}
+	return 0;
+}
 
-		cout << "\tN: " << currentN << endl;
-		cout << "\t\t iterations:    " << iterations << endl;
-		cout << "\t\t average calcs: " << averageCalcs << endl;
 
-		currentN *= 2;
+/**
+ *	@brief	Run the D dimensional engines for a dimension chosen at run time.
+ *	
+ *	@param dimension	Number of coordinates per point, 3 to MAX_DIMENSION
+ *	
+ *	@return Zero on success.
+ */
+int runDimension(int dimension)
+{
+	switch( dimension )
+	{
+		case 3: return runDimensionOf<3>();
+		case 4: return runDimensionOf<4>();
+		case 5: return runDimensionOf<5>();
+		case 6: return runDimensionOf<6>();
+		case 7: return runDimensionOf<7>();
+		case 8: return runDimensionOf<8>();
 	}
+
+	cout << "Error: --dim must be between 3 and " << MAX_DIMENSION << endl;
+	return 1;
 }
 
-vector<Point> points;
-Algorithm selected_algorithm;
 
 int main(int argc, char* argv[])
 {
 	srand(time(NULL));
 
-	//runTests();
+	// closest index builds a kd-tree index file or answers queries from one
+	if( argc >= 2 && equalIC(argv[1], "INDEX") )
+		return runIndex(argc, argv);
+
+	// closest calibrate measures the fastest base case size and caches it for --cutoff auto
+	if( argc >= 2 && equalIC(argv[1], "CALIBRATE") )
+	{
+		calibrateAndCacheCutoff(true);
+		return 0;
+	}
+
+	// closest bench times every engine over a set of N values
+	if( argc >= 2 && equalIC(argv[1], "BENCH") )
+		return runBenchmark(argc, argv);
+
+	// closest selftest checks the query engines against brute force on random points
+	if( argc >= 2 && equalIC(argv[1], "SELFTEST") )
+		return runSelfTest(argc, argv);
+
+	// closest convert IN OUT turns a text point file into a binary one
+	if( argc >= 4 && equalIC(argv[1], "CONVERT") )
+	{
+		int threads = max(1u, thread::hardware_concurrency());
+		return convertPointFile(argv[2], argv[3], threads);
+	}
+
+	// closest windowbench compares the sliding window with recomputing every window
+	if( argc >= 2 && equalIC(argv[1], "WINDOWBENCH") )
+		return runWindowBenchmark(argc >= 3 ? strtoull(argv[2], nullptr, 10) : 1);
 
-	// Verify we have enough arguments
-	if( argc < 2)
+	// closest stream keeps the closest pair up to date as points arrive on std input
+	if( argc >= 2 && equalIC(argv[1], "STREAM") )
+		return runStream();
+
+	// Options can come before or after the algorithm, which is the first argument that is not one
+	const char* algorithm = nullptr;
+	for(int a = 1; a < argc; a++)
+	{
+		bool hasValue = a+1 < argc;
+		if( equalIC(argv[a], "--threads") && hasValue )
+			selected_threads = max(1, atoi(argv[++a]));
+		else if( equalIC(argv[a], "--sort") && hasValue )
+			selected_sort = equalIC(argv[++a], "MERGE") ? MERGE_SORT : RADIX_SORT;
+		else if( equalIC(argv[a], "--seed") && hasValue )
+			selected_seed = strtoull(argv[++a], nullptr, 10);
+		else if( equalIC(argv[a], "--input") && hasValue )
+			selected_input = argv[++a];
+		else if( equalIC(argv[a], "--top-k") && hasValue )
+			selected_top_k = max(0, atoi(argv[++a]));
+		else if( equalIC(argv[a], "--all-nn") )
+			selected_all_nn = true;
+		else if( equalIC(argv[a], "--compact") )
+			selected_compact = true;
+		else if( equalIC(argv[a], "--dim") && hasValue )
+			selected_dimension = atoi(argv[++a]);
+		else if( equalIC(argv[a], "--blue") && hasValue )
+			selected_blue = argv[++a];
+		else if( equalIC(argv[a], "--cutoff") && hasValue )
+			applyCutoff(argv[++a]);
+		else if( argv[a][0] == '-' )
+		{
+			cout << "Error: unknown option or missing value: " << argv[a] << "\n";
+			cout << "Usage: closest [algorithm] [--input FILE] [--threads N] [--sort radix|merge] [--seed S] "
+				<< "[--cutoff N|auto] [--top-k K] [--all-nn] [--compact] [--dim D] [--blue FILE]" << endl;
+			return 1;
+		}
+		else if( algorithm == nullptr )
+			algorithm = argv[a];
+	}
+
+	// The top k, all nearest neighbour, bichromatic and compact runs don't use the algorithm
+	bool needsAlgorithm = selected_top_k == 0 && !selected_all_nn && selected_blue.empty() && !selected_compact;
+	if( algorithm == nullptr )
 	{
-		selected_algorithm = getAlgorithm();
+		if( needsAlgorithm )
+			selected_algorithm = getAlgorithm();
 	}
 	else
 	{
-		if( equalIC(argv[1], "BRUTE"))
+		if( equalIC(algorithm, "BRUTE"))
 			selected_algorithm = BRUTE;
-		else if( equalIC(argv[1], "DIVIDE"))
+		else if( equalIC(algorithm, "DIVIDE"))
 			selected_algorithm = DIVIDE;
-		else if( equalIC(argv[1], "BOTH"))
+		else if( equalIC(algorithm, "INPLACE"))
+			selected_algorithm = INPLACE;
+		else if( equalIC(algorithm, "PARALLEL"))
+			selected_algorithm = PARALLEL;
+		else if( equalIC(algorithm, "GRID"))
+			selected_algorithm = GRID;
+		else if( equalIC(algorithm, "SWEEP"))
+			selected_algorithm = SWEEP;
+		else if( equalIC(algorithm, "SHAMOS"))
+			selected_algorithm = SHAMOS;
+		else if( equalIC(algorithm, "ITERATIVE"))
+			selected_algorithm = ITERATIVE;
+		else if( equalIC(algorithm, "BOTH"))
 			selected_algorithm = BOTH;
 		else
 			selected_algorithm = getAlgorithm();
 	}
-	
 
-	// Take in the number of points
-	cout << "Enter point count: ";
-	int count = getNextPos();
+	// Anything but 2D goes to the D dimensional engines, 2D keeps the path below
+	if( selected_dimension != 2 )
+		return runDimension(selected_dimension);
 
+	// --compact picks the coordinate type from the data instead of reading ints
+	if( selected_compact )
+		return runCompact(selected_input);
+	
 
-	// Loop and get the points
-	for(int p = 0; p < count; p++)
+	if( !selected_input.empty() )
+	{
+		string error;
+		uint32_t flags;
+		if( !openPoints(selected_input, points, point_file, point_data, point_count, flags, selected_threads, error) )
+		{
+			cout << "Error: " << error << endl;
+			return 1;
+		}
+		points_sorted_x = flags & SORTED_BY_X;
+	}
+	else
 	{
-		int x = getNextInt();
-		int y = getNextInt();
+		// Take in the number of points
+		cout << "Enter point count: ";
+		size_t count = getNextPos();
+
 
-		points.emplace_back( x, y );
+		// Loop and get the points
+		for(size_t p = 0; p < count; p++)
+		{
+			int x = getNextInt();
+			int y = getNextInt();
+
+			points.emplace_back( x, y );
+		}
+	}
+
+	if( point_data == nullptr )
+	{
+		point_data = points.data();
+		point_count = points.size();
 	}
 
 
 	// Punch out the sorts
-	if( points.size() >= 2)
+	if( !selected_blue.empty() )
+	{
+		vector<Point> bluePoints;
+		MappedFile blueFile;
+		const Point* blueData = nullptr;
+		size_t blueCount = 0;
+		uint32_t flags;
+		string error;
+		if( !openPoints(selected_blue, bluePoints, blueFile, blueData, blueCount, flags, selected_threads, error) )
+		{
+			cout << "Error: " << error << endl;
+			return 1;
+		}
+		if( point_count < 1 || blueCount < 1 )
+		{
+			cout << "Error: both sets need at least one point" << endl;
+			return 1;
+		}
+
+		resetStats();
+		pair<Point, Point> closest{point_data[0], blueData[0]};
+		long long ds = bichromaticClosestPair(point_data, point_count, blueData, blueCount, closest, selected_threads);
+
+		cout << "Algorithm: Bichromatic (kd-tree over the " << (point_count <= blueCount ? "red" : "blue") << " set)\n\n";
+		cout << "N: " << point_count << " red, " << blueCount << " blue\n\n";
+		cout << "Red point: (" << closest.first.x << ", " << closest.first.y << ")\n";
+		cout << "Blue point: (" << closest.second.x << ", " << closest.second.y << ")\n\n";
+		cout << "Distance squared: " << ds << "\n\n";
+		cout << "Distance: " << sqrt(double(ds)) << "\n\n";
+		printStats(false);
+	}
+	else if( point_count >= 2 && selected_top_k > 0 )
+	{
+		resetStats();
+
+		vector<ClosePair> best = topKClosestPairs(point_data, point_count, selected_top_k);
+
+		cout << "Algorithm: Top " << selected_top_k << " closest pairs\n\n";
+		cout << "N: " << point_count << "\n\n";
+		for(size_t i = 0; i < best.size(); i++)
+		{
+			cout << i+1 << ": (" << best[i].a.x << ", " << best[i].a.y << ") ("
+				<< best[i].b.x << ", " << best[i].b.y << ")  Distance squared: " << best[i].dist << "\n";
+		}
+		cout << "\n";
+		printStats(true);
+	}
+	else if( point_count >= 2 && selected_all_nn )
+	{
+		resetStats();
+
+		vector<long long> nearest;
+		vector<long long> dist;
+		allNearestNeighbours(point_data, point_count, selected_threads, nearest, dist);
+
+		cout << "Algorithm: All nearest neighbours\n\n";
+		cout << "N: " << point_count << "\n\n";
+		for(size_t i = 0; i < point_count; i++)
+		{
+			const Point& a = point_data[i];
+			const Point& b = point_data[nearest[i]];
+			cout << "(" << a.x << ", " << a.y << ") -> (" << b.x << ", " << b.y << ")  Distance squared: " << dist[i] << "\n";
+		}
+		cout << "\n";
+		printStats(false);
+	}
+	else if( point_count >= 2)
 	{
 		if( selected_algorithm == DIVIDE || selected_algorithm ==  BOTH)
 		{
-			DISTANCE_CALCULATIONS = 0;
-			cout << "Algorithm: Divide and Conquer\n\n";
+			resetStats();
+
+			pair<Point, Point> closest{point_data[0], point_data[1]};
+			long long ds = divideClosestPoint(point_data, point_count, closest, false, points_sorted_x);
+
+			printResult("Divide and Conquer", closest, ds, true);
+		}
+
+		if( selected_algorithm == INPLACE )
+		{
+			resetStats();
+
+			pair<Point, Point> closest{point_data[0], point_data[1]};
+			long long ds = divideClosestPoint(point_data, point_count, closest, true, points_sorted_x);
+
+			printResult("Divide and Conquer (in place)", closest, ds, true);
+		}
+
+		if( selected_algorithm == PARALLEL )
+		{
+			resetStats();
+
+			pair<Point, Point> closest{point_data[0], point_data[1]};
+			long long ds = parallelClosestPoint(point_data, point_count, closest, selected_threads, points_sorted_x);
+
+			printResult("Divide and Conquer (" + to_string(selected_threads) + " threads)", closest, ds, true);
+		}
+
+		if( selected_algorithm == GRID )
+		{
+			resetStats();
+
+			pair<Point, Point> closest{point_data[0], point_data[1]};
+			long long ds = gridClosestPoint(point_data, point_count, closest, selected_seed);
+
+			printResult("Randomized Grid (seed " + to_string(selected_seed) + ")", closest, ds, false);
+		}
+
+		if( selected_algorithm == SWEEP )
+		{
+			resetStats();
+
+			pair<Point, Point> closest{point_data[0], point_data[1]};
+			long long ds = sweepClosestPoint(point_data, point_count, closest, points_sorted_x);
+
+			printResult("Plane Sweep", closest, ds, false);
+		}
+
+		if( selected_algorithm == SHAMOS )
+		{
+			resetStats();
 
-			cout << "N: " << points.size() << "\n\n";
+			pair<Point, Point> closest{point_data[0], point_data[1]};
+			long long ds = shamosClosestPoint(point_data, point_count, closest, points_sorted_x);
 
-			pair<Point, Point> closest{points[0], points[1]};
+			printResult("Divide and Conquer (single presort)", closest, ds, true);
+		}
 
-			long long distance = divideClosestPoint(points, closest);
-			long long ds = distance*distance;					
+		if( selected_algorithm == ITERATIVE )
+		{
+			resetStats();
 
-			cout << "Point 1: (" << closest.first.x << ", " << closest.first.y << ")\n";
-			cout << "Point 2: (" << closest.second.x << ", " << closest.second.y << ")\n\n";
+			pair<Point, Point> closest{point_data[0], point_data[1]};
+			long long ds = iterativeClosestPoint(point_data, point_count, closest, points_sorted_x);
 
-			cout << "Distance squared: " << ds << "\n\n";
-			cout << "Distance: " << distance << "\n\n";
-			cout << "Number of distance calcs: " << DISTANCE_CALCULATIONS << endl;
-			cout << "Number of calls: " << RECURSIVE_CALLS << endl;
+			printResult("Divide and Conquer (bottom up)", closest, ds, true);
 		}
 
 		if( selected_algorithm == BOTH )
@@ -716,27 +6588,17 @@ int main(int argc, char* argv[])
 
 		if(selected_algorithm == BRUTE || selected_algorithm == BOTH)
 		{
-			DISTANCE_CALCULATIONS = 0;
-
-			cout << "Algorithm: Brute Force\n\n";
-
-			cout << "N: " << points.size() << "\n\n";
-	
-			pair<Point, Point> closest{points[0], points[1]};
-			long long distance = bruteForceClosestPair(points, closest);
-			long long ds = distance*distance;
+			resetStats();
 
-			cout << "Point 1: (" << closest.first.x << ", " << closest.first.y << ")\n";
-			cout << "Point 2: (" << closest.second.x << ", " << closest.second.y << ")\n\n";
+			pair<Point, Point> closest{point_data[0], point_data[1]};
+			long long ds = bruteForceClosestPair(point_data, point_count, closest);
 
-			cout << "Distance squared: " << ds << "\n\n";
-			cout << "Distance: " << distance << "\n\n";
-			cout << "Number of distance calcs: " << DISTANCE_CALCULATIONS << endl;
+			printResult("Brute Force", closest, ds, false);
 		}
 	}
 	else
 	{
-		cout << "Error: n = " << points.size() << ". Should be >= 2" << endl;
+		cout << "Error: n = " << point_count << ". Should be >= 2" << endl;
 	}
 
 